@@ -0,0 +1,43 @@
+#include "AcquisitionPool.h"
+
+AcquisitionPool::AcquisitionPool(size_t capacity)
+    : free_(capacity)
+    , allocated_(0)
+    , reused_(0)
+    , dropped_(0)
+{
+}
+
+AcquisitionPool::~AcquisitionPool()
+{
+    ISMRMRD::Acquisition *acq;
+    while (free_.pop(acq)) {
+        delete acq;
+    }
+}
+
+std::unique_ptr<ISMRMRD::Acquisition> AcquisitionPool::take()
+{
+    ISMRMRD::Acquisition *acq;
+    if (free_.pop(acq)) {
+        reused_++;
+        return std::unique_ptr<ISMRMRD::Acquisition>(acq);
+    }
+    allocated_++;
+    return std::unique_ptr<ISMRMRD::Acquisition>(new ISMRMRD::Acquisition());
+}
+
+void AcquisitionPool::recycle(std::unique_ptr<ISMRMRD::Acquisition> acq)
+{
+    if (acq && free_.push(acq.get())) {
+        acq.release();
+    } else if (acq) {
+        dropped_++;
+    }
+}
+
+void AcquisitionPool::printStatistics(std::ostream &os) const
+{
+    os << "Acquisition pool: " << allocated_ << " allocated, " << reused_ << " reused, " << dropped_
+       << " dropped" << std::endl;
+}
@@ -0,0 +1,47 @@
+#ifndef ACQUISITIONPOOL_H_
+#define ACQUISITIONPOOL_H_
+
+#include "ismrmrd/ismrmrd.h"
+
+#include <boost/lockfree/spsc_queue.hpp>
+
+#include <atomic>
+#include <memory>
+#include <ostream>
+
+/// Acquisitions that have been written and can be filled again.
+///
+/// The number of samples and channels rarely changes within a measurement, so an acquisition
+/// taken from the pool usually already has data (and trajectory) storage of the right size and
+/// getAcquisition() does not have to resize it. Once as many acquisitions exist as are in flight
+/// between the reader and the writer, the scan loop no longer allocates.
+///
+/// take() is called by the thread that reads the measurement and recycle() by the thread that
+/// writes it (they may be the same), the free list is a lock-free single producer/single
+/// consumer queue. Acquisitions recycled while the pool is full are deleted.
+class AcquisitionPool
+{
+public:
+    explicit AcquisitionPool(size_t capacity);
+    ~AcquisitionPool();
+
+    /// A recycled acquisition, or a new one if there is none. The header keeps the values of
+    /// the previous use, getAcquisition() overwrites all fields it does not leave at zero.
+    std::unique_ptr<ISMRMRD::Acquisition> take();
+
+    void recycle(std::unique_ptr<ISMRMRD::Acquisition> acq);
+
+    void printStatistics(std::ostream &os) const;
+
+private:
+    AcquisitionPool(const AcquisitionPool &);
+    AcquisitionPool &operator=(const AcquisitionPool &);
+
+    boost::lockfree::spsc_queue<ISMRMRD::Acquisition *> free_;
+
+    unsigned long allocated_;
+    unsigned long reused_;
+    std::atomic<unsigned long> dropped_;
+};
+
+#endif //ACQUISITIONPOOL_H_
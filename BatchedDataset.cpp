@@ -0,0 +1,211 @@
+#include "BatchedDataset.h"
+
+#include <stdexcept>
+
+// The types below mirror the compound types ISMRMRD uses for the "data" dataset
+// (see get_hdf5type_acquisition in ismrmrd/libsrc/dataset.c)
+
+static void insert_array(hid_t datatype, const char *name, size_t offset, hid_t base_type, hsize_t len)
+{
+    hid_t arraytype = H5Tarray_create2(base_type, 1, &len);
+    H5Tinsert(datatype, name, offset, arraytype);
+    H5Tclose(arraytype);
+}
+
+static hid_t get_hdf5type_encoding()
+{
+    typedef ISMRMRD::ISMRMRD_EncodingCounters T;
+    hid_t datatype = H5Tcreate(H5T_COMPOUND, sizeof(T));
+    H5Tinsert(datatype, "kspace_encode_step_1", HOFFSET(T, kspace_encode_step_1), H5T_NATIVE_UINT16);
+    H5Tinsert(datatype, "kspace_encode_step_2", HOFFSET(T, kspace_encode_step_2), H5T_NATIVE_UINT16);
+    H5Tinsert(datatype, "average", HOFFSET(T, average), H5T_NATIVE_UINT16);
+    H5Tinsert(datatype, "slice", HOFFSET(T, slice), H5T_NATIVE_UINT16);
+    H5Tinsert(datatype, "contrast", HOFFSET(T, contrast), H5T_NATIVE_UINT16);
+    H5Tinsert(datatype, "phase", HOFFSET(T, phase), H5T_NATIVE_UINT16);
+    H5Tinsert(datatype, "repetition", HOFFSET(T, repetition), H5T_NATIVE_UINT16);
+    H5Tinsert(datatype, "set", HOFFSET(T, set), H5T_NATIVE_UINT16);
+    H5Tinsert(datatype, "segment", HOFFSET(T, segment), H5T_NATIVE_UINT16);
+    insert_array(datatype, "user", HOFFSET(T, user), H5T_NATIVE_UINT16, ISMRMRD::ISMRMRD_USER_INTS);
+    return datatype;
+}
+
+static hid_t get_hdf5type_acquisitionheader()
+{
+    typedef ISMRMRD::ISMRMRD_AcquisitionHeader T;
+    hid_t datatype = H5Tcreate(H5T_COMPOUND, sizeof(T));
+    H5Tinsert(datatype, "version", HOFFSET(T, version), H5T_NATIVE_UINT16);
+    H5Tinsert(datatype, "flags", HOFFSET(T, flags), H5T_NATIVE_UINT64);
+    H5Tinsert(datatype, "measurement_uid", HOFFSET(T, measurement_uid), H5T_NATIVE_UINT32);
+    H5Tinsert(datatype, "scan_counter", HOFFSET(T, scan_counter), H5T_NATIVE_UINT32);
+    H5Tinsert(datatype, "acquisition_time_stamp", HOFFSET(T, acquisition_time_stamp), H5T_NATIVE_UINT32);
+    insert_array(datatype, "physiology_time_stamp", HOFFSET(T, physiology_time_stamp), H5T_NATIVE_UINT32,
+                 ISMRMRD::ISMRMRD_PHYS_STAMPS);
+    H5Tinsert(datatype, "number_of_samples", HOFFSET(T, number_of_samples), H5T_NATIVE_UINT16);
+    H5Tinsert(datatype, "available_channels", HOFFSET(T, available_channels), H5T_NATIVE_UINT16);
+    H5Tinsert(datatype, "active_channels", HOFFSET(T, active_channels), H5T_NATIVE_UINT16);
+    insert_array(datatype, "channel_mask", HOFFSET(T, channel_mask), H5T_NATIVE_UINT64,
+                 ISMRMRD::ISMRMRD_CHANNEL_MASKS);
+    H5Tinsert(datatype, "discard_pre", HOFFSET(T, discard_pre), H5T_NATIVE_UINT16);
+    H5Tinsert(datatype, "discard_post", HOFFSET(T, discard_post), H5T_NATIVE_UINT16);
+    H5Tinsert(datatype, "center_sample", HOFFSET(T, center_sample), H5T_NATIVE_UINT16);
+    H5Tinsert(datatype, "encoding_space_ref", HOFFSET(T, encoding_space_ref), H5T_NATIVE_UINT16);
+    H5Tinsert(datatype, "trajectory_dimensions", HOFFSET(T, trajectory_dimensions), H5T_NATIVE_UINT16);
+    H5Tinsert(datatype, "sample_time_us", HOFFSET(T, sample_time_us), H5T_NATIVE_FLOAT);
+    insert_array(datatype, "position", HOFFSET(T, position), H5T_NATIVE_FLOAT, ISMRMRD::ISMRMRD_POSITION_LENGTH);
+    insert_array(datatype, "read_dir", HOFFSET(T, read_dir), H5T_NATIVE_FLOAT, ISMRMRD::ISMRMRD_DIRECTION_LENGTH);
+    insert_array(datatype, "phase_dir", HOFFSET(T, phase_dir), H5T_NATIVE_FLOAT, ISMRMRD::ISMRMRD_DIRECTION_LENGTH);
+    insert_array(datatype, "slice_dir", HOFFSET(T, slice_dir), H5T_NATIVE_FLOAT, ISMRMRD::ISMRMRD_DIRECTION_LENGTH);
+    insert_array(datatype, "patient_table_position", HOFFSET(T, patient_table_position), H5T_NATIVE_FLOAT,
+                 ISMRMRD::ISMRMRD_POSITION_LENGTH);
+    hid_t encodingtype = get_hdf5type_encoding();
+    H5Tinsert(datatype, "idx", HOFFSET(T, idx), encodingtype);
+    H5Tclose(encodingtype);
+    insert_array(datatype, "user_int", HOFFSET(T, user_int), H5T_NATIVE_INT32, ISMRMRD::ISMRMRD_USER_INTS);
+    insert_array(datatype, "user_float", HOFFSET(T, user_float), H5T_NATIVE_FLOAT, ISMRMRD::ISMRMRD_USER_FLOATS);
+    return datatype;
+}
+
+static hid_t get_hdf5type_acquisition()
+{
+    hid_t datatype = H5Tcreate(H5T_COMPOUND, sizeof(HDF5_Acquisition));
+
+    hid_t headtype = get_hdf5type_acquisitionheader();
+    H5Tinsert(datatype, "head", HOFFSET(HDF5_Acquisition, head), headtype);
+    H5Tclose(headtype);
+
+    // Both trajectory and data are stored as variable length float arrays
+    hid_t vlentype = H5Tvlen_create(H5T_NATIVE_FLOAT);
+    H5Tinsert(datatype, "traj", HOFFSET(HDF5_Acquisition, traj), vlentype);
+    H5Tinsert(datatype, "data", HOFFSET(HDF5_Acquisition, data), vlentype);
+    H5Tclose(vlentype);
+
+    return datatype;
+}
+
+// Rows per chunk when this class creates the "data" dataset.
+// ISMRMRD uses a chunk size of 1, i.e. one chunk (and one B-tree entry) per acquisition.
+const hsize_t DATA_CHUNK_SIZE = 64;
+
+std::mutex &hdf5_mutex()
+{
+    static std::mutex mutex;
+    return mutex;
+}
+
+static void delete_locked(BatchedDataset *dataset)
+{
+    std::lock_guard<std::mutex> lock(hdf5_mutex());
+    delete dataset;
+}
+
+boost::shared_ptr<BatchedDataset> BatchedDataset::create(const char *filename, const char *groupname)
+{
+    std::lock_guard<std::mutex> lock(hdf5_mutex());
+    return boost::shared_ptr<BatchedDataset>(new BatchedDataset(filename, groupname, true), delete_locked);
+}
+
+BatchedDataset::BatchedDataset(const char *filename, const char *groupname, bool create_file_if_needed)
+    : ISMRMRD::Dataset(filename, groupname, create_file_if_needed)
+    , data_path_(std::string(groupname) + "/data")
+    , acquisition_type_(get_hdf5type_acquisition())
+    , dataset_(-1)
+{
+}
+
+BatchedDataset::~BatchedDataset()
+{
+    // Must happen before ISMRMRD::Dataset closes the file
+    closeDataset();
+    H5Tclose(acquisition_type_);
+}
+
+void BatchedDataset::openDataset()
+{
+    if (dataset_ >= 0) {
+        return;
+    }
+
+    hid_t fileid = dset_.fileid;
+    if (H5Lexists(fileid, data_path_.c_str(), H5P_DEFAULT) > 0) {
+        dataset_ = H5Dopen2(fileid, data_path_.c_str(), H5P_DEFAULT);
+    } else {
+        hsize_t dims = 0;
+        hsize_t maxdims = H5S_UNLIMITED;
+        hid_t dataspace = H5Screate_simple(1, &dims, &maxdims);
+
+        hid_t lcpl = H5Pcreate(H5P_LINK_CREATE);
+        H5Pset_create_intermediate_group(lcpl, 1);
+
+        hid_t dcpl = H5Pcreate(H5P_DATASET_CREATE);
+        hsize_t chunk = DATA_CHUNK_SIZE;
+        H5Pset_chunk(dcpl, 1, &chunk);
+
+        dataset_ = H5Dcreate2(fileid, data_path_.c_str(), acquisition_type_, dataspace, lcpl, dcpl, H5P_DEFAULT);
+
+        H5Pclose(dcpl);
+        H5Pclose(lcpl);
+        H5Sclose(dataspace);
+    }
+
+    if (dataset_ < 0) {
+        dataset_ = -1;
+        throw std::runtime_error("Failed to open HDF5 dataset " + data_path_);
+    }
+}
+
+void BatchedDataset::closeDataset()
+{
+    if (dataset_ >= 0) {
+        H5Dclose(dataset_);
+        dataset_ = -1;
+    }
+}
+
+void BatchedDataset::reserve(size_t batch_size)
+{
+    rows_.reserve(batch_size);
+}
+
+void BatchedDataset::appendAcquisitions(const std::vector<ISMRMRD::Acquisition *> &acqs)
+{
+    if (acqs.empty()) {
+        return;
+    }
+
+    // Only grows if a batch is bigger than all before it, resize never shrinks the capacity
+    rows_.resize(acqs.size());
+    for (size_t i = 0; i < acqs.size(); i++) {
+        const ISMRMRD::Acquisition &acq = *acqs[i];
+        rows_[i].head = acq.getHead();
+        rows_[i].traj.len = acq.getNumberOfTrajElements();
+        rows_[i].traj.p = const_cast<float *>(acq.getTrajPtr());
+        rows_[i].data.len = 2 * acq.getNumberOfDataElements();
+        rows_[i].data.p = const_cast<complex_float_t *>(acq.getDataPtr());
+    }
+
+    openDataset();
+
+    hid_t filespace = H5Dget_space(dataset_);
+    hsize_t offset = 0;
+    H5Sget_simple_extent_dims(filespace, &offset, NULL);
+    H5Sclose(filespace);
+
+    hsize_t count = rows_.size();
+    hsize_t new_size = offset + count;
+    if (H5Dset_extent(dataset_, &new_size) < 0) {
+        throw std::runtime_error("Failed to extend HDF5 dataset " + data_path_);
+    }
+
+    filespace = H5Dget_space(dataset_);
+    H5Sselect_hyperslab(filespace, H5S_SELECT_SET, &offset, NULL, &count, NULL);
+    hid_t memspace = H5Screate_simple(1, &count, NULL);
+
+    herr_t status = H5Dwrite(dataset_, acquisition_type_, memspace, filespace, H5P_DEFAULT, &rows_[0]);
+
+    H5Sclose(memspace);
+    H5Sclose(filespace);
+
+    if (status < 0) {
+        throw std::runtime_error("Failed to write acquisitions to HDF5 dataset " + data_path_);
+    }
+}
@@ -0,0 +1,60 @@
+#ifndef BATCHEDDATASET_H_
+#define BATCHEDDATASET_H_
+
+#include "ismrmrd/ismrmrd.h"
+#include "ismrmrd/dataset.h"
+
+#include <hdf5.h>
+#include <boost/shared_ptr.hpp>
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+/// The HDF5 library is not thread safe in its default build. Any thread calling into HDF5
+/// while other threads may do the same must hold this lock.
+std::mutex &hdf5_mutex();
+
+/// One row of the "data" dataset, in the compound layout ISMRMRD uses for it
+/// (see get_hdf5type_acquisition in ismrmrd/libsrc/dataset.c)
+struct HDF5_Acquisition
+{
+    ISMRMRD::ISMRMRD_AcquisitionHeader head;
+    hvl_t traj;
+    hvl_t data;
+};
+
+/// ISMRMRD::Dataset that can append many acquisitions with a single HDF5 write.
+///
+/// ISMRMRD::Dataset::appendAcquisition extends the "data" dataset by one row per call.
+/// appendAcquisitions extends it once per batch and writes the whole batch as one hyperslab,
+/// using the same compound layout as ISMRMRD, so the file reads back with any ISMRMRD reader.
+class BatchedDataset : public ISMRMRD::Dataset
+{
+public:
+    BatchedDataset(const char *filename, const char *groupname, bool create_file_if_needed = true);
+    ~BatchedDataset();
+
+    /// Opens the dataset while holding hdf5_mutex(), and closes it under the same lock
+    /// once the last reference is released
+    static boost::shared_ptr<BatchedDataset> create(const char *filename, const char *groupname);
+
+    /// Rows for batches of up to batch_size acquisitions are allocated once and reused by every batch
+    void reserve(size_t batch_size);
+
+    void appendAcquisitions(const std::vector<ISMRMRD::Acquisition *> &acqs);
+
+private:
+    BatchedDataset(const BatchedDataset &);
+    BatchedDataset &operator=(const BatchedDataset &);
+
+    void openDataset();
+    void closeDataset();
+
+    std::string data_path_;
+    hid_t acquisition_type_;
+    hid_t dataset_;
+    std::vector<HDF5_Acquisition> rows_;
+};
+
+#endif //BATCHEDDATASET_H_
@@ -0,0 +1,1677 @@
+#include <libxml/parser.h>
+#include <libxml/xmlschemas.h>
+#include <libxml/xmlmemory.h>
+#include <libxml/debugXML.h>
+#include <libxml/HTMLtree.h>
+#include <libxml/xmlIO.h>
+#include <libxml/xinclude.h>
+#include <libxml/catalog.h>
+#include <libxslt/xslt.h>
+#include <libxslt/xsltInternals.h>
+#include <libxslt/transform.h>
+#include <libxslt/xsltutils.h>
+#include <boost/make_shared.hpp>
+
+#include "Converter.h"
+#include "EvalInfoMask.h"
+#include "base64.h"
+#include "ConverterXml.h"
+
+#include <boost/algorithm/string.hpp>
+#include <boost/locale/encoding_utf.hpp>
+using boost::locale::conv::utf_to_utf;
+
+#include <iomanip>
+
+#include <iostream>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <streambuf>
+#include <utility>
+#include <typeinfo>
+#include <algorithm>
+#include <set>
+#include <tuple>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+std::mutex xml_mutex;
+
+
+
+// Compiled XSLT stylesheets and XSD schemas, keyed by their content. Every measurement of a run uses the same
+// ones, so they are compiled once and kept until the process exits. Only used with xml_mutex held.
+class XmlCache
+{
+public:
+    ~XmlCache()
+    {
+        for (std::map<std::string, xsltStylesheetPtr>::iterator it = stylesheets_.begin(); it != stylesheets_.end(); ++it) {
+            xsltFreeStylesheet(it->second);
+        }
+        for (std::map<std::string, Schema>::iterator it = schemas_.begin(); it != schemas_.end(); ++it) {
+            xmlSchemaFree(it->second.schema);
+            xmlFreeDoc(it->second.doc);
+        }
+        xsltCleanupGlobals();
+        xmlCleanupParser();
+    }
+
+    // Returns NULL if the stylesheet can not be parsed
+    xsltStylesheetPtr stylesheet(const std::string &content)
+    {
+        std::map<std::string, xsltStylesheetPtr>::iterator it = stylesheets_.find(content);
+        if (it != stylesheets_.end()) {
+            return it->second;
+        }
+
+        xmlDocPtr xsl_doc = xmlParseMemory(content.c_str(), content.size());
+        if (xsl_doc == NULL) {
+            return NULL;
+        }
+
+        //The stylesheet takes ownership of the document
+        xsltStylesheetPtr cur = xsltParseStylesheetDoc(xsl_doc);
+        if (cur == NULL) {
+            xmlFreeDoc(xsl_doc);
+            return NULL;
+        }
+        stylesheets_[content] = cur;
+        return cur;
+    }
+
+    // Returns 0 and sets schema on success, otherwise the error code of xml_file_is_valid
+    int schema(const std::string &content, xmlSchemaPtr &schema)
+    {
+        std::map<std::string, Schema>::iterator it = schemas_.find(content);
+        if (it != schemas_.end()) {
+            schema = it->second.schema;
+            return 0;
+        }
+
+        //parse an XML in-memory block and build a tree.
+        xmlDocPtr schema_doc = xmlParseMemory(content.c_str(), content.size());
+
+        //Create an XML Schemas parse context for that document. NB. The document may be modified during the parsing process.
+        xmlSchemaParserCtxtPtr parser_ctxt = xmlSchemaNewDocParserCtxt(schema_doc);
+        if (parser_ctxt == NULL) {
+            /* unable to create a parser context for the schema */
+            xmlFreeDoc(schema_doc);
+            return -2;
+        }
+
+        //parse a schema definition resource and build an internal XML Shema structure which can be used to validate instances.
+        Schema entry;
+        entry.doc = schema_doc;
+        entry.schema = xmlSchemaParse(parser_ctxt);
+        xmlSchemaFreeParserCtxt(parser_ctxt);
+        if (entry.schema == NULL) {
+            /* the schema itself is not valid */
+            xmlFreeDoc(schema_doc);
+            return -3;
+        }
+
+        schemas_[content] = entry;
+        schema = entry.schema;
+        return 0;
+    }
+
+private:
+    struct Schema
+    {
+        xmlDocPtr doc;
+        xmlSchemaPtr schema;
+    };
+
+    std::map<std::string, xsltStylesheetPtr> stylesheets_;
+    std::map<std::string, Schema> schemas_;
+};
+
+XmlCache xml_cache;
+
+int xml_file_is_valid(const std::string &xml, const std::string &schema_file) {
+    xmlSchemaPtr schema = NULL;
+    int status = xml_cache.schema(schema_file, schema);
+    if (status < 0) {
+        return status;
+    }
+
+    xmlDocPtr doc;
+    //parse an XML in-memory block and build a tree.
+    doc = xmlParseMemory(xml.c_str(), xml.size());
+
+    //Create an XML Schemas validation context based on the given schema.
+    xmlSchemaValidCtxtPtr valid_ctxt = xmlSchemaNewValidCtxt(schema);
+    if (valid_ctxt == NULL) {
+        /* unable to create a validation context for the schema */
+        xmlFreeDoc(doc);
+        return -4;
+    }
+
+    //Validate a document tree in memory. Takes a schema validation context and a parsed document tree
+    int is_valid = (xmlSchemaValidateDoc(valid_ctxt, doc) == 0);
+    xmlSchemaFreeValidCtxt(valid_ctxt);
+    xmlFreeDoc(doc);
+
+    /* force the return value to be non-negative on success */
+    return is_valid ? 1 : 0;
+}
+
+
+std::string get_date_time_string() {
+    time_t rawtime;
+    struct tm *timeinfo;
+    time(&rawtime);
+    timeinfo = localtime(&rawtime);
+
+    std::stringstream str;
+    str << timeinfo->tm_year + 1900 << "-"
+        << std::setw(2) << std::setfill('0') << timeinfo->tm_mon + 1
+        << "-"
+        << std::setw(2) << std::setfill('0') << timeinfo->tm_mday
+        << " "
+        << std::setw(2) << std::setfill('0') << timeinfo->tm_hour
+        << ":"
+        << std::setw(2) << std::setfill('0') << timeinfo->tm_min
+        << ":"
+        << std::setw(2) << std::setfill('0') << timeinfo->tm_sec;
+
+    std::string ret = str.str();
+
+    return ret;
+}
+
+
+bool is_number(const std::string &s) {
+    bool ret = true;
+    for (unsigned int i = 0; i < s.size(); i++) {
+        if (!std::isdigit(s.c_str()[i])) {
+            ret = false;
+            break;
+        }
+    }
+    return ret;
+}
+
+std::string get_time_string(size_t hours, size_t mins, size_t secs) {
+    std::stringstream str;
+    str << std::setw(2) << std::setfill('0') << hours << ":"
+        << std::setw(2) << std::setfill('0') << mins << ":"
+        << std::setw(2) << std::setfill('0') << secs;
+
+    std::string ret = str.str();
+
+    return ret;
+}
+
+bool fill_ismrmrd_header(ISMRMRD::IsmrmrdHeader &h, const std::string &study_date, const std::string &study_time) {
+    try {
+
+        // ---------------------------------
+        // fill more info into the ismrmrd header
+        // ---------------------------------
+        // study
+        bool study_date_needed = false;
+        bool study_time_needed = false;
+
+        if (h.studyInformation) {
+            if (!h.studyInformation->studyDate) {
+                study_date_needed = true;
+            }
+
+            if (!h.studyInformation->studyTime) {
+                study_time_needed = true;
+            }
+        } else {
+            study_date_needed = true;
+            study_time_needed = true;
+        }
+
+        if (study_date_needed || study_time_needed) {
+            ISMRMRD::StudyInformation study;
+
+            if(h.studyInformation)
+                study = *h.studyInformation;
+
+            if(study_date_needed && !study_date.empty())
+            {
+                study.studyDate.set(study_date);
+                std::cout << "Study date: " << study_date << std::endl;
+            }
+
+            if (study_time_needed && !study_time.empty()) {
+                study.studyTime.set(study_time);
+                std::cout << "Study time: " << study_time << std::endl;
+            }
+
+            h.studyInformation.set(study);
+        }
+
+        // ---------------------------------
+        // go back to string
+        // ---------------------------------
+
+
+    }
+    catch (...) {
+        return false;
+    }
+
+    return true;
+}
+
+void append_buffers_to_xml_header(std::vector<MeasurementHeaderBuffer> &buffers, size_t num_buffers,
+                                  ISMRMRD::IsmrmrdHeader &header) {
+
+    for (unsigned int b = 0; b < num_buffers; b++) {
+        ISMRMRD::UserParameterString p;
+        p.value = base64_encode(reinterpret_cast<const unsigned char *>(buffers[b].buf.c_str()), buffers[b].buf.size());
+        p.name = std::string("SiemensBuffer_") + buffers[b].name;
+        if (!header.userParameters.is_present()) {
+            ISMRMRD::UserParameters up;
+            header.userParameters = up;
+        }
+        header.userParameters().userParameterBase64.push_back(p);
+    }
+
+}
+
+ParameterMap parseParameterMap(const std::string &mapfile) {
+    ParameterMap map;
+    map.valid = false;
+
+    TiXmlDocument doc;
+    doc.Parse(mapfile.c_str());
+    TiXmlHandle docHandle(&doc);
+
+    TiXmlElement *parameters = docHandle.FirstChildElement("siemens").FirstChildElement("parameters").ToElement();
+    if (!parameters) {
+        std::cout << "Malformed parameter map (parameters section not found)" << std::endl;
+        return map;
+    }
+    map.valid = true;
+
+    TiXmlNode *p = 0;
+    while ((p = parameters->IterateChildren("p", p))) {
+        TiXmlHandle ph(p);
+
+        TiXmlText *s = ph.FirstChildElement("s").FirstChild().ToText();
+        TiXmlText *d = ph.FirstChildElement("d").FirstChild().ToText();
+
+        if (s && d) {
+            std::string source = s->Value();
+            std::string destination = d->Value();
+
+            std::vector<std::string> split_path;
+            boost::split(split_path, source, boost::is_any_of("."), boost::token_compress_on);
+
+            if (is_number(split_path[0])) {
+                std::cout << "First element of path (" << source << ") cannot be numeric" << std::endl;
+                continue;
+            }
+
+            std::string search_path = split_path[0];
+            for (unsigned int i = 1; i < split_path.size() - 1; i++) {
+                /*
+                if (is_number(split_path[i]) && (i != split_path.size())) {
+                std::cout << "Numeric index not supported inside path for source = " << source << std::endl;
+                continue;
+                }*/
+
+                search_path += std::string(".") + split_path[i];
+            }
+
+            int index = -1;
+            if (is_number(split_path[split_path.size() - 1])) {
+                index = atoi(split_path[split_path.size() - 1].c_str());
+            } else {
+                search_path += std::string(".") + split_path[split_path.size() - 1];
+            }
+
+            ParameterMapEntry entry;
+            entry.search_path = search_path;
+            entry.index = index;
+            entry.destination = destination;
+            map.entries.push_back(entry);
+        } else {
+            std::cout << "Malformed parameter map" << std::endl;
+        }
+    }
+    return map;
+}
+
+// The same parameter map is used by every measurement, so it is only parsed once per distinct content
+boost::shared_ptr<const ParameterMap> compileParameterMap(const std::string &mapfile) {
+    static std::mutex cache_mutex;
+    static std::map<std::string, boost::shared_ptr<const ParameterMap> > cache;
+
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    boost::shared_ptr<const ParameterMap> &map = cache[mapfile];
+    if (!map) {
+        map = boost::make_shared<ParameterMap>(parseParameterMap(mapfile));
+    }
+    return map;
+}
+
+std::string ProcessParameterMap(const XProtocol::XNodeIndex &node_index, const ParameterMap &map) {
+    if (!map.valid) {
+        return std::string("");
+    }
+
+    TiXmlDocument out_doc;
+
+    TiXmlDeclaration *decl = new TiXmlDeclaration("1.0", "", "");
+    out_doc.LinkEndChild(decl);
+
+    ConverterXMLNode out_n(&out_doc);
+
+    for (size_t i = 0; i < map.entries.size(); i++) {
+        const ParameterMapEntry &entry = map.entries[i];
+        const std::string &search_path = entry.search_path;
+        const int index = entry.index;
+
+        const XProtocol::XNode *n = node_index.find(search_path);
+
+        std::vector<std::string> parameters;
+        if (n) {
+            parameters = boost::apply_visitor(XProtocol::getStringValueArray(), *n);
+        } else {
+            std::cout << "Search path: " << search_path << " not found." << std::endl;
+        }
+
+        if (index >= 0) {
+            if (parameters.size() > index) {
+                out_n.add(entry.destination, parameters[index]);
+            } else {
+                std::cout << "Parameter index (" << index << ") not valid for search path " << search_path
+                          << std::endl;
+                continue;
+            }
+        } else {
+            out_n.add(entry.destination, parameters);
+        }
+    }
+    return XmlToString(out_doc);
+}
+
+
+/// compute noise dwell time in us for dependency and built-in noise in VD/VB lines
+double compute_noise_sample_in_us(size_t num_of_noise_samples_this_acq, bool isAdjustCoilSens, bool isAdjQuietCoilSens,
+                                  bool isVB, bool isNX)
+{
+    if(isNX)
+    {
+        return 5.0;
+    }
+    else if (isAdjustCoilSens)
+    {
+        return 5.0;
+    }
+    else if (isAdjQuietCoilSens)
+    {
+        return 4.0;
+    }
+    else if (isVB)
+    {
+        return (1e6 / num_of_noise_samples_this_acq / 130.0);
+    }
+    else
+    {
+        return (((long) (76800.0 / num_of_noise_samples_this_acq)) / 10.0);
+    }
+
+    return 5.0;
+}
+
+const EmbeddedFile *findEmbeddedFile(const std::string &name) {
+    const EmbeddedFile *begin = embedded_files;
+    const EmbeddedFile *end = embedded_files + embedded_file_count;
+    const EmbeddedFile *it = std::lower_bound(begin, end, name, [](const EmbeddedFile &file, const std::string &n) {
+        return n.compare(file.name) > 0;
+    });
+    if (it != end && name == it->name) {
+        return it;
+    }
+    return NULL;
+}
+
+std::string load_embedded(std::string name) {
+    const EmbeddedFile *file = findEmbeddedFile(name);
+    if (!file) {
+        std::stringstream sstream;
+        sstream << "ERROR: File " << name << " is not embedded!";
+        throw std::runtime_error(sstream.str());
+    }
+    return std::string(file->data, file->size);
+}
+
+std::string load_file(std::string file_name) {
+    // Read in file contents
+    std::string contents;
+
+    std::ifstream f(file_name.c_str());
+    if (!f) {
+        std::stringstream sstream;
+        sstream << "file: " << file_name << " does not exist.";
+        throw std::runtime_error(sstream.str());
+    }
+    std::string str_f((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+    contents = str_f;
+
+    return contents;
+}
+
+
+std::string ws2s(const std::wstring &wstr) {
+    std::string ret(wstr.size(), '0');
+    for (size_t i = 0; i < wstr.size(); i++) {
+        wchar_t c = wstr[i];
+        if (((uint32_t) c) > 127) {
+            ret[i] = 'X';
+        } else {
+            ret[i] = static_cast<char>(c);
+        }
+    }
+    return ret;
+}
+
+// Number of bytes before the first one with the high bit set, 64 bytes per step
+static size_t asciiPrefixLength(const char *data, size_t len) {
+    size_t i = 0;
+#ifdef __SSE2__
+    for (; i + 64 <= len; i += 64) {
+        const __m128i *p = reinterpret_cast<const __m128i *>(data + i);
+        __m128i any = _mm_or_si128(_mm_or_si128(_mm_loadu_si128(p), _mm_loadu_si128(p + 1)),
+                                   _mm_or_si128(_mm_loadu_si128(p + 2), _mm_loadu_si128(p + 3)));
+        if (_mm_movemask_epi8(any)) {
+            break;
+        }
+    }
+#elif defined(__aarch64__)
+    for (; i + 64 <= len; i += 64) {
+        const uint8_t *p = reinterpret_cast<const uint8_t *>(data + i);
+        uint8x16_t any = vorrq_u8(vorrq_u8(vld1q_u8(p), vld1q_u8(p + 16)), vorrq_u8(vld1q_u8(p + 32), vld1q_u8(p + 48)));
+        if (vmaxvq_u8(any) & 0x80) {
+            break;
+        }
+    }
+#endif
+    for (; i < len; i++) {
+        if (static_cast<unsigned char>(data[i]) & 0x80) {
+            break;
+        }
+    }
+    return i;
+}
+
+ConversionSettings::ConversionSettings()
+    : debug_xml(false)
+    , flash_pat_ref_scan(false)
+    , header_only(false)
+    , append_buffers(false)
+    , all_measurements(false)
+    , skip_syncdata(false)
+    , skip_validation(false)
+    , attachTrajectory(false)
+    , writer_queue_depth(256)
+    , writer_batch_size(64)
+    , writer_batch_mb(16)
+    , follow_timeout(0)
+    , VBFILE(false)
+{
+    ParcRaidHead.hdSize_ = 0;
+    ParcRaidHead.count_ = 0;
+}
+
+bool readFileLayout(DatReader &siemens_dat, ConversionSettings &settings) {
+    MrParcRaidFileHeader ParcRaidHead;
+
+    siemens_dat.seek(0);
+    siemens_dat.read(ParcRaidHead);
+
+    bool VBFILE = false;
+
+    if (ParcRaidHead.hdSize_ > 32) {
+        VBFILE = true;
+
+        //Rewind, we have no raid file header.
+        siemens_dat.seek(0);
+
+        ParcRaidHead.hdSize_ = ParcRaidHead.count_;
+        ParcRaidHead.count_ = 1;
+    }
+    else if (ParcRaidHead.hdSize_ != 0) {
+        //This is a VB line data file
+        std::cerr << "Only VD line files with MrParcRaidFileHeader.hdSize_ == 0 (MR_PARC_RAID_ALLDATA) supported."
+            << std::endl;
+        return false;
+    }
+
+    settings.VBFILE = VBFILE;
+    settings.ParcRaidHead = ParcRaidHead;
+    settings.ParcFileEntries = readParcFileEntries(siemens_dat, ParcRaidHead, VBFILE);
+    if (settings.schema_file_name_content.empty()) {
+        settings.schema_file_name_content = load_embedded("ismrmrd.xsd");
+    }
+    return true;
+}
+
+void readChannelData(DatReader &siemens_dat, bool VBFILE, const sScanHeader &scanhead, complex_float_t *data) {
+    size_t nchannels = scanhead.ushUsedChannels;
+    size_t nsamples = scanhead.ushSamplesInScan;
+    if (nchannels == 0) {
+        return;
+    }
+
+    size_t channel_header_size = sizeof(sChannelHeader);
+    if (VBFILE) {
+        // Rewind to the mdh of the first channel
+        // It was read once to create scanhead
+        siemens_dat.skip(-(int64_t) sizeof(sMDH));
+        channel_header_size = sizeof(sMDH);
+    }
+
+    // The channel headers carry nothing we need, so they are skipped in place and
+    // each payload is read into its slot of the (channel major) data buffer.
+    size_t payload_size = nsamples * sizeof(complex_float_t);
+    if (!data) {
+        siemens_dat.skip(nchannels * (channel_header_size + payload_size));
+        return;
+    }
+
+    for (unsigned int c = 0; c < nchannels; c++) {
+        siemens_dat.skip(channel_header_size);
+        if (!siemens_dat.read(data + c * nsamples, payload_size)) {
+            return;
+        }
+    }
+}
+
+// Walks the scan headers of one measurement by their DMA length, without reading any payload
+MeasurementIndex indexMeasurement(DatReader &siemens_dat, bool VBFILE, const MrParcRaidFileEntry &entry, unsigned int number) {
+    MeasurementIndex m;
+    m.number = number;
+    m.meas_id = entry.measId_;
+    m.file_id = entry.fileId_;
+    m.protocol_name = std::string(entry.protName_, strnlen(entry.protName_, sizeof(entry.protName_)));
+    m.offset = entry.off_;
+    m.length = entry.len_;
+
+    // Skip the measurement header buffers, as the conversion does
+    siemens_dat.seek(entry.off_);
+    uint32_t dma_length = 0, num_buffers = 0;
+    siemens_dat.read(dma_length);
+    siemens_dat.read(num_buffers);
+    for (uint32_t b = 0; b < num_buffers && siemens_dat.good(); b++) {
+        siemens_dat.read_string(32);
+        uint32_t buflen = 0;
+        siemens_dat.read(buflen);
+        siemens_dat.skip(buflen);
+    }
+    uint64_t position_in_meas = siemens_dat.tell() - entry.off_;
+    if (position_in_meas % 32 != 0) {
+        siemens_dat.skip(32 - (position_in_meas % 32));
+    }
+    m.data_offset = siemens_dat.tell();
+
+    uint64_t measurement_end = entry.off_ + entry.len_;
+    sMDH mdh;
+    while (siemens_dat.good() && siemens_dat.tell() + sizeof(sScanHeader) < measurement_end) {
+        sScanHeader scanhead;
+        readScanHeader(siemens_dat, VBFILE, mdh, scanhead);
+        if (!siemens_dat) {
+            break;
+        }
+        m.scans++;
+
+        for (unsigned int bit = 0; bit < 64; bit++) {
+            if (scanhead.aulEvalInfoMask[bit / 32] & (1u << (bit % 32))) {
+                m.eval_info_mask_bits[bit]++;
+            }
+        }
+
+        if (scanhead.aulEvalInfoMask[0] & (1 << 5)) {
+            //Syncdata, see readSyncdata
+            uint32_t length = scanhead.ulFlagsAndDMALength & MDH_DMA_LENGTH_MASK;
+            uint64_t next = siemens_dat.tell() + length - (VBFILE ? sizeof(sMDH) : sizeof(sScanHeader));
+            m.sync_packets++;
+            if (!VBFILE) {
+                uint32_t packetSize;
+                char packedID[52];
+                siemens_dat.read(packetSize);
+                if (siemens_dat.read(packedID, sizeof(packedID))) {
+                    packedID[sizeof(packedID) - 1] = '\0';
+                    if (strstr(packedID, "PMU")) {
+                        m.pmu_packets++;
+                    }
+                }
+            }
+            siemens_dat.seek(next);
+            continue;
+        }
+
+        readChannelData(siemens_dat, VBFILE, scanhead, NULL);
+
+        if (scanhead.aulEvalInfoMask[0] & 1) {
+            m.acqend = true;
+            break;
+        }
+
+        m.acquisitions++;
+        m.complex_samples += (uint64_t) scanhead.ushUsedChannels * scanhead.ushSamplesInScan;
+        m.channels[scanhead.ushUsedChannels]++;
+        m.samples[scanhead.ushSamplesInScan]++;
+    }
+    m.end_offset = siemens_dat.tell();
+    siemens_dat.clear();
+
+    return m;
+}
+
+void readScanHeader(DatReader &siemens_dat, bool VBFILE, sMDH &mdh, sScanHeader &scanhead) {
+    if (VBFILE) {
+        if (!siemens_dat.read(mdh)) {
+            return;
+        }
+        scanhead.ulFlagsAndDMALength = mdh.ulFlagsAndDMALength;
+        scanhead.lMeasUID = mdh.lMeasUID;
+        scanhead.ulScanCounter = mdh.ulScanCounter;
+        scanhead.ulTimeStamp = mdh.ulTimeStamp;
+        scanhead.ulPMUTimeStamp = mdh.ulPMUTimeStamp;
+        scanhead.ushSystemType = 0;
+        scanhead.ulPTABPosDelay = 0;
+        scanhead.lPTABPosX = 0;
+        scanhead.lPTABPosY = 0;
+        scanhead.lPTABPosZ = mdh.ushPTABPosNeg;//TODO: Modify calculation
+        scanhead.ulReserved1 = 0;
+        scanhead.aulEvalInfoMask[0] = mdh.aulEvalInfoMask[0];
+        scanhead.aulEvalInfoMask[1] = mdh.aulEvalInfoMask[1];
+        scanhead.ushSamplesInScan = mdh.ushSamplesInScan;
+        scanhead.ushUsedChannels = mdh.ushUsedChannels;
+        scanhead.sLC = mdh.sLC;
+        scanhead.sCutOff = mdh.sCutOff;
+        scanhead.ushKSpaceCentreColumn = mdh.ushKSpaceCentreColumn;
+        scanhead.ushCoilSelect = mdh.ushCoilSelect;
+        scanhead.fReadOutOffcentre = mdh.fReadOutOffcentre;
+        scanhead.ulTimeSinceLastRF = mdh.ulTimeSinceLastRF;
+        scanhead.ushKSpaceCentreLineNo = mdh.ushKSpaceCentreLineNo;
+        scanhead.ushKSpaceCentrePartitionNo = mdh.ushKSpaceCentrePartitionNo;
+        scanhead.sSliceData = mdh.sSliceData;
+        memset(scanhead.aushIceProgramPara, 0, sizeof(uint16_t) * 24);
+        memcpy(scanhead.aushIceProgramPara, mdh.aushIceProgramPara, 8 * sizeof(uint16_t));
+        memset(scanhead.aushReservedPara, 0, sizeof(uint16_t) * 4);
+        scanhead.ushApplicationCounter = 0;
+        scanhead.ushApplicationMask = 0;
+        scanhead.ulCRC = 0;
+    } else {
+        siemens_dat.read(scanhead);
+    }
+}
+
+// Acquisition::resize reallocates the data and trajectory even if the size does not change,
+// recycled acquisitions nearly always have the right size already
+static void resizeAcquisition(ISMRMRD::Acquisition &acq, uint16_t samples, uint16_t channels, uint16_t traj_dims) {
+    if (acq.number_of_samples() != samples || acq.active_channels() != channels ||
+        acq.trajectory_dimensions() != traj_dims) {
+        acq.resize(samples, channels, traj_dims);
+    }
+}
+
+void
+getAcquisition(bool flash_pat_ref_scan, const Trajectory &trajectory, long dwell_time_0, long* global_table_pos, long max_channels,
+               bool isAdjustCoilSens, bool isAdjQuietCoilSens, bool isVB, bool isNX, const SpiralTrajectory *traj,
+               const sScanHeader &scanhead, DatReader &siemens_dat, bool VBFILE, ISMRMRD::Acquisition &ismrmrd_acq) {
+    // The number of samples, channels and trajectory dimensions is set below
+
+    // Acquisition header values are zero by default. A recycled acquisition still has the flags
+    // and the encoding space of its previous scan, the other fields are all overwritten.
+    ismrmrd_acq.clearAllFlags();
+    ismrmrd_acq.encoding_space_ref() = 0;
+    ismrmrd_acq.measurement_uid() = scanhead.lMeasUID;
+    ismrmrd_acq.scan_counter() = scanhead.ulScanCounter;
+    ismrmrd_acq.acquisition_time_stamp() = scanhead.ulTimeStamp;
+    ismrmrd_acq.physiology_time_stamp()[0] = scanhead.ulPMUTimeStamp;
+    ismrmrd_acq.available_channels() = (uint16_t) max_channels;
+    // uint64_t channel_mask[16];     //Mask to indicate which channels are active. Support for 1024 channels
+    ismrmrd_acq.discard_pre() = scanhead.sCutOff.ushPre;
+    ismrmrd_acq.discard_post() = scanhead.sCutOff.ushPost;
+    ismrmrd_acq.center_sample() = scanhead.ushKSpaceCentreColumn;
+
+    // std::cout << "isAdjustCoilSens, isVB : " << isAdjustCoilSens << " " << isVB << std::endl;
+
+    if (scanhead.aulEvalInfoMask[0] & (1ULL << 25))
+    { //This is noise
+        ismrmrd_acq.sample_time_us() = compute_noise_sample_in_us(scanhead.ushSamplesInScan, isAdjustCoilSens,
+                                                                  isAdjQuietCoilSens, isVB, isNX);
+
+        // std::cout << "Noise sample time us :" << ismrmrd_acq.sample_time_us() << std::endl;
+    } else {
+        ismrmrd_acq.sample_time_us() = dwell_time_0 / 1000.0f;
+    }
+    // std::cout << "ismrmrd_acq.sample_time_us(): " << ismrmrd_acq.sample_time_us() << std::endl;
+
+    ismrmrd_acq.position()[0] = scanhead.sSliceData.sSlicePosVec.flSag;// + (float) (global_table_pos[0]);
+    ismrmrd_acq.position()[1] = scanhead.sSliceData.sSlicePosVec.flCor;// + (float) (global_table_pos[1]);
+    ismrmrd_acq.position()[2] = scanhead.sSliceData.sSlicePosVec.flTra;// + (float) (global_table_pos[2]);
+
+    // Convert Siemens quaternions to direction cosines.
+    // In the Siemens convention the quaternion corresponds to a rotation matrix with columns P R S
+    // Siemens stores the quaternion as (W,X,Y,Z)
+    float quat[4];
+    quat[0] = scanhead.sSliceData.aflQuaternion[1]; // X
+    quat[1] = scanhead.sSliceData.aflQuaternion[2]; // Y
+    quat[2] = scanhead.sSliceData.aflQuaternion[3]; // Z
+    quat[3] = scanhead.sSliceData.aflQuaternion[0]; // W
+    ISMRMRD::ismrmrd_quaternion_to_directions(quat,
+                                              ismrmrd_acq.phase_dir(),
+                                              ismrmrd_acq.read_dir(),
+                                              ismrmrd_acq.slice_dir());
+
+    //std::cout << "scanhead.ulScanCounter         = " << scanhead.ulScanCounter << std::endl;
+    //std::cout << "quat         = [" << quat[0] << " " << quat[1] << " " << quat[2] << " " << quat[3] << "]" << std::endl;
+    //std::cout << "phase_dir    = [" << ismrmrd_acq.phase_dir()[0] << " " << ismrmrd_acq.phase_dir()[1] << " " << ismrmrd_acq.phase_dir()[2] << "]" << std::endl;
+    //std::cout << "read_dir     = [" << ismrmrd_acq.read_dir()[0] << " " << ismrmrd_acq.read_dir()[1] << " " << ismrmrd_acq.read_dir()[2] << "]" << std::endl;
+    //std::cout << "slice_dir    = [" << ismrmrd_acq.slice_dir()[0] << " " << ismrmrd_acq.slice_dir()[1] << " " << ismrmrd_acq.slice_dir()[2] << "]" << std::endl;
+    //std::cout << "--------------------------------------------------------" << std::endl;
+
+    ismrmrd_acq.patient_table_position()[0] = (float) scanhead.lPTABPosX;
+    ismrmrd_acq.patient_table_position()[1] = (float) scanhead.lPTABPosY;
+    ismrmrd_acq.patient_table_position()[2] = (float) scanhead.lPTABPosZ;
+
+    ismrmrd_acq.idx().average = scanhead.sLC.ushAcquisition;
+    ismrmrd_acq.idx().contrast = scanhead.sLC.ushEcho;
+    ismrmrd_acq.idx().kspace_encode_step_1 = scanhead.sLC.ushLine;
+    ismrmrd_acq.idx().kspace_encode_step_2 = scanhead.sLC.ushPartition;
+    ismrmrd_acq.idx().phase = scanhead.sLC.ushPhase;
+    ismrmrd_acq.idx().repetition = scanhead.sLC.ushRepetition;
+    ismrmrd_acq.idx().segment = scanhead.sLC.ushSeg;
+    ismrmrd_acq.idx().set = scanhead.sLC.ushSet;
+    ismrmrd_acq.idx().slice = scanhead.sLC.ushSlice;
+    ismrmrd_acq.idx().user[0] = scanhead.sLC.ushIda;
+    ismrmrd_acq.idx().user[1] = scanhead.sLC.ushIdb;
+    ismrmrd_acq.idx().user[2] = scanhead.sLC.ushIdc;
+    ismrmrd_acq.idx().user[3] = scanhead.sLC.ushIdd;
+    ismrmrd_acq.idx().user[4] = scanhead.sLC.ushIde;
+    // TODO: remove this once the GTPlus can properly autodetect partial fourier
+    //ismrmrd_acq.idx().user[5] = scanhead.ushKSpaceCentreLineNo;
+    //ismrmrd_acq.idx().user[6] = scanhead.ushKSpaceCentrePartitionNo;
+
+    /*****************************************************************************/
+    /* the user_int[0] and user_int[1] are used to store user defined parameters */
+    /*****************************************************************************/
+    ismrmrd_acq.user_int()[0] = scanhead.aushIceProgramPara[0];
+    ismrmrd_acq.user_int()[1] = scanhead.aushIceProgramPara[1];
+    ismrmrd_acq.user_int()[2] = scanhead.aushIceProgramPara[2];
+    ismrmrd_acq.user_int()[3] = scanhead.aushIceProgramPara[3];
+    ismrmrd_acq.user_int()[4] = scanhead.aushIceProgramPara[4];
+    ismrmrd_acq.user_int()[5] = scanhead.aushIceProgramPara[5];
+    ismrmrd_acq.user_int()[6] = scanhead.aushIceProgramPara[6];
+    // TODO: in the newer version of ismrmrd, add field to store time_since_perp_pulse
+    ismrmrd_acq.user_int()[7] = scanhead.ulTimeSinceLastRF;
+
+    ismrmrd_acq.user_float()[0] = scanhead.aushIceProgramPara[8];
+    ismrmrd_acq.user_float()[1] = scanhead.aushIceProgramPara[9];
+    ismrmrd_acq.user_float()[2] = scanhead.aushIceProgramPara[10];
+    ismrmrd_acq.user_float()[3] = scanhead.aushIceProgramPara[11];
+    ismrmrd_acq.user_float()[4] = scanhead.aushIceProgramPara[12];
+    ismrmrd_acq.user_float()[5] = scanhead.aushIceProgramPara[13];
+    ismrmrd_acq.user_float()[6] = scanhead.aushIceProgramPara[14];
+    ismrmrd_acq.user_float()[7] = scanhead.aushIceProgramPara[15];
+
+    // Eval info mask bits -> ISMRMRD flags, see eval_info_rules in EvalInfoMask.cpp
+    // The flags were cleared above, the table gives all of them at once
+    ismrmrd_acq.setFlags(evalInfoFlagTable(evalInfoVariant(isVB, isNX)).flags(scanhead.aulEvalInfoMask));
+
+    if ((flash_pat_ref_scan) & (ismrmrd_acq.isFlagSet(ISMRMRD::ISMRMRD_ACQ_IS_PARALLEL_CALIBRATION))) {
+        // For some sequences the PAT Reference data is collected using a different encoding space
+        // e.g. EPI scans with FLASH PAT Reference
+        // enabled by command line option
+        // TODO: it is likely that the dwell time is not set properly for this type of acquisition
+        ismrmrd_acq.encoding_space_ref() = 1;
+    }
+
+    if (traj && (trajectory == Trajectory::TRAJECTORY_SPIRAL) &&
+        !ismrmrd_acq.isFlagSet(ISMRMRD::ISMRMRD_ACQ_IS_NOISE_MEASUREMENT) &&
+        ismrmrd_acq.idx().kspace_encode_step_1 < traj->interleaves) { //Spiral and not noise, we will add the trajectory to the data
+
+        // traj->dimensions = 2, traj->samples = points per interleaf, traj->interleaves = no. of interleaves
+        // kspace_encode_step_1 is the interleaf number
+
+        // Set the acquisition number of samples, channels and trajectory dimensions
+        resizeAcquisition(ismrmrd_acq, scanhead.ushSamplesInScan, scanhead.ushUsedChannels, traj->dimensions);
+
+        unsigned long traj_samples_to_copy = ismrmrd_acq.number_of_samples();
+        if (traj->samples < traj_samples_to_copy) {
+            traj_samples_to_copy = (unsigned long) traj->samples;
+            ismrmrd_acq.discard_post() = (uint16_t) (ismrmrd_acq.number_of_samples() - traj_samples_to_copy);
+        }
+        const float *t_ptr = traj->interleaf(ismrmrd_acq.idx().kspace_encode_step_1);
+        memcpy((void *) ismrmrd_acq.getTrajPtr(), t_ptr, sizeof(float) * traj->dimensions * traj_samples_to_copy);
+        memset((void *) (ismrmrd_acq.getTrajPtr() + traj->dimensions * traj_samples_to_copy), 0,
+               sizeof(float) * traj->dimensions * (ismrmrd_acq.number_of_samples() - traj_samples_to_copy));
+    } else { //No trajectory
+        // Set the acquisition number of samples, channels and trajectory dimensions
+        resizeAcquisition(ismrmrd_acq, scanhead.ushSamplesInScan, scanhead.ushUsedChannels, 0);
+    }
+
+    readChannelData(siemens_dat, VBFILE, scanhead, ismrmrd_acq.getDataPtr());
+
+
+    if (scanhead.ulScanCounter % 1000 == 0) {
+        std::cout << "wrote scan : " << scanhead.ulScanCounter << std::endl;
+    }
+}
+
+std::tuple<std::vector<uint32_t>, std::vector<uint32_t>> unpack_pmu(const std::vector<PMUdata> &data) {
+
+    auto tup = std::make_tuple(std::vector<uint32_t>(), std::vector<uint32_t>());
+    std::get<0>(tup).reserve(data.size());
+    std::get<1>(tup).reserve(data.size());
+
+    for (auto d : data) {
+
+        std::get<0>(tup).push_back(d.data);
+        std::get<1>(tup).push_back(d.trigger);
+    }
+    return tup;
+}
+
+
+void makeWaveformHeader(ISMRMRD::IsmrmrdHeader &header) {
+
+    if (!header.waveformInformation.size()) {
+        for (int learning_phase = false; learning_phase <= true; learning_phase++) {
+            ISMRMRD::WaveformInformation info;
+            ISMRMRD::UserParameterLong userParam;
+            ISMRMRD::UserParameterString userParamString;
+            userParamString.name = "Phase";
+            if (learning_phase) {
+                userParamString.value = "Learning";
+            } else {
+                userParamString.value = "Acquisition";
+            }
+
+            userParam.name = "TriggerChannel";
+            userParam.value = 4; //Trigger is stored in 5th channel for ECG
+            info.waveformName = "ECG";
+            info.waveformType = ISMRMRD::WaveformType::ECG;
+            info.userParameters = ISMRMRD::UserParameters();
+            info.userParameters.get().userParameterLong.push_back(userParam);
+            header.waveformInformation.push_back(info);
+
+
+            info.waveformName = "PULS";
+            info.waveformType = ISMRMRD::WaveformType::PULSE;
+            info.userParameters.get().userParameterLong[0].value = 1; //Trigger is storend in 2nd channel everything else
+            header.waveformInformation.push_back(info);
+
+            info.waveformName = "RESP";
+            info.waveformType = ISMRMRD::WaveformType::RESPIRATORY;
+            header.waveformInformation.push_back(info);
+
+            info.waveformName = "EXT1";
+            info.waveformType = ISMRMRD::WaveformType::OTHER;
+            header.waveformInformation.push_back(info);
+
+            info.waveformName = "EXT2";
+            info.waveformType = ISMRMRD::WaveformType::OTHER;
+            header.waveformInformation.push_back(info);
+        }
+
+    }
+
+
+}
+
+const std::map<PMU_Type, int> waveformId = {{PMU_Type::ECG1, 0},
+                                            {PMU_Type::ECG2, 0},
+                                            {PMU_Type::ECG3, 0},
+                                            {PMU_Type::ECG4, 0},
+                                            {PMU_Type::PULS, 1},
+                                            {PMU_Type::RESP, 2},
+                                            {PMU_Type::EXT1, 3},
+                                            {PMU_Type::EXT2, 4}};
+
+//It appears Siemens hard-codes sample times for their PMU systems, which sounds suspicious
+//const std::map<PMU_Type, float> sample_time_us = {{PMU_Type::ECG1,2500},{PMU_Type::ECG2,2500},{PMU_Type::ECG3,2500},{PMU_Type::ECG4,2500},
+//                                               {PMU_Type::PULS,5000},
+//                                               {PMU_Type::RESP,20000},
+//                                               {PMU_Type::EXT1,20000},
+//                                               {PMU_Type::EXT2,20000}};
+
+std::set<PMU_Type> PMU_Types = {PMU_Type::ECG1, PMU_Type::ECG2, PMU_Type::ECG3, PMU_Type::ECG4, PMU_Type::PULS,
+                                PMU_Type::RESP, PMU_Type::EXT1, PMU_Type::EXT2, PMU_Type::END};
+
+std::vector<ISMRMRD::Waveform> readSyncdata(DatReader &siemens_dat, bool VBFILE, unsigned long acquisitions,
+                                            uint32_t dma_length, sScanHeader scanheader, ISMRMRD::IsmrmrdHeader &header,
+                                            long last_scan_counter, bool skip_syncdata) {
+
+    size_t len = 0;
+    if (VBFILE) {
+        len = dma_length - sizeof(sMDH);
+        //Is VB magic? For now let's assume it's not, and that this is just Siemens secret sauce.
+        siemens_dat.skip(len);
+        return std::vector<ISMRMRD::Waveform>();
+    } else {
+        len = dma_length - sizeof(sScanHeader);
+
+//        siemens_dat.seekg(len,siemens_dat.cur);
+//        return std::vector<ISMRMRD::Waveform>();
+        uint64_t cur_pos = siemens_dat.tell();
+        uint32_t packetSize;
+        siemens_dat.read(packetSize);
+        std::string packedID;
+        {
+            char packedIDArr[52];
+            siemens_dat.read(packedIDArr, 52);
+            packedID = packedIDArr;
+
+        }
+
+        if ((skip_syncdata) || (packedID.find("PMU") == packedID.npos)) { //packedID indicates this isn't PMU data, so let's jump ship.
+            siemens_dat.seek(cur_pos + len);
+            return std::vector<ISMRMRD::Waveform>();
+
+        }
+
+        bool learning_phase = packedID.find("PMULearnPhase") != packedID.npos;
+
+        uint32_t swappedFlag, timestamp0, timestamp, packerNr, duration;
+
+        siemens_dat.read(swappedFlag);
+        siemens_dat.read(timestamp0);
+        siemens_dat.read(timestamp);
+        siemens_dat.read(packerNr);
+        siemens_dat.read(duration);
+
+        PMU_Type magic;
+        siemens_dat.read(magic);
+        //Read in all the PMU data first, to figure out if we have multiple ECGs.
+        std::map<PMU_Type, std::tuple<std::vector<PMUdata>, uint32_t >> pmu_map;
+        std::set<PMU_Type> ecg_types = {PMU_Type::ECG1, PMU_Type::ECG2, PMU_Type::ECG3, PMU_Type::ECG4};
+        std::map<PMU_Type, std::tuple<std::vector<PMUdata>, uint32_t >> ecg_map;
+        while (magic != PMU_Type::END) {
+            //Read and store period
+            uint32_t period;
+
+            siemens_dat.read(period);
+
+            //Allocate and read data
+            std::vector<PMUdata> data(duration / period);
+            siemens_dat.read((char *) data.data(), data.size() * sizeof(PMUdata));
+            //Split into ECG and PMU sets.
+            if (ecg_types.count(magic)) {
+                ecg_map[magic] = std::make_tuple(std::move(data), period);
+            } else {
+                pmu_map[magic] = std::make_tuple(std::move(data), period);
+            }
+            //Read next tag
+            siemens_dat.read(magic);
+            if (!PMU_Types.count(magic))
+                throw std::runtime_error("Malformed file");
+
+
+        }
+
+        //Have to handle ECG separately.
+
+        std::vector<ISMRMRD::Waveform> waveforms;
+        waveforms.reserve(5);
+        if (ecg_map.size() > 0 || pmu_map.size() > 0) {
+
+            if (ecg_map.size() > 0) {
+
+                size_t channels = ecg_map.size();
+                size_t number_of_elements = std::get<0>(ecg_map.begin()->second).size();
+
+                auto ecg_waveform = ISMRMRD::Waveform(number_of_elements, channels + 1);
+                ecg_waveform.head.waveform_id = waveformId.at(PMU_Type::ECG1) + 5 * learning_phase;
+
+                uint32_t *ecg_waveform_data = ecg_waveform.data;
+
+                uint32_t *trigger_data = ecg_waveform_data + number_of_elements * channels;
+                std::fill(trigger_data, trigger_data + number_of_elements, 0);
+                //Copy in the data
+                for (auto key_val : ecg_map) {
+                    auto tup = unpack_pmu(std::get<0>(key_val.second));
+                    auto &data = std::get<0>(tup);
+                    auto &trigger = std::get<1>(tup);
+
+                    std::copy(data.begin(), data.end(), ecg_waveform_data);
+                    ecg_waveform_data += data.size();
+
+                    for (auto i = 0; i < number_of_elements; i++) trigger_data[i] |= trigger[i];
+
+                }
+
+//                ecg_waveform.head.sample_time_us = sample_time_us.at(PMU_Type::ECG1);
+                waveforms.push_back(std::move(ecg_waveform));
+
+
+            }
+
+
+            for (auto key_val : pmu_map) {
+                auto tup = unpack_pmu(std::get<0>(key_val.second));
+                auto &data = std::get<0>(tup);
+                auto &trigger = std::get<1>(tup);
+
+                auto waveform = ISMRMRD::Waveform(data.size(), 2);
+                waveform.head.waveform_id = waveformId.at(key_val.first) + 5 * learning_phase;
+                std::copy(data.begin(), data.end(), waveform.data);
+
+                std::copy(trigger.begin(), trigger.end(), waveform.data + data.size());
+
+//                waveform.head.sample_time_us = sample_time_us.at(key_val.first);
+                waveforms.push_back(std::move(waveform));
+            }
+            //Figure out number of ECG channels
+
+
+        }
+
+
+        for (auto &waveform : waveforms) {
+            waveform.head.time_stamp = timestamp;
+            waveform.head.measurement_uid = scanheader.lMeasUID;
+            waveform.head.scan_counter = last_scan_counter;
+            waveform.head.sample_time_us = double(duration * 100) / waveform.head.number_of_samples;
+        }
+
+        if (waveforms.size()) makeWaveformHeader(header); //Add the header if needed
+
+        siemens_dat.seek(cur_pos + len);
+        return waveforms;
+
+
+    }
+}
+
+//
+//void getsyncData(std::ifstream &siemens_dat, bool VBFILE, uint32_t dma_length) {
+//    size_t len = 0;
+//    if (VBFILE)
+//             {
+//                 len = dma_length-sizeof(sMDH);
+//             }
+//             else
+//             {
+//                 len = dma_length-sizeof(sScanHeader);
+//             }
+//
+//    std::vector<uint8_t> syncdata(len);
+//    siemens_dat.read(reinterpret_cast<char*>(&syncdata[0]), len);
+//}
+
+// Applies the parameter stylesheet. The result is not validated here; the complete header is validated once it
+// has been filled in, before it is written.
+std::string parseXML(bool debug_xml, const std::string &parammap_xsl_content, const std::string xml_config) {
+    xsltStylesheetPtr cur = NULL;
+
+    xmlDocPtr doc, res;
+
+    const char *params[16 + 1];
+
+    int nbparams = 0;
+
+    params[nbparams] = NULL;
+
+    xmlSubstituteEntitiesDefault(1);
+
+    xmlLoadExtDtdDefaultValue = 1;
+
+    cur = xml_cache.stylesheet(parammap_xsl_content);
+
+    if (cur == NULL) {
+        std::stringstream sstream;
+        sstream << "Error when parsing xsl parameter stylesheet...";
+        throw std::runtime_error(sstream.str());
+
+    }
+
+    doc = xmlParseMemory(xml_config.c_str(), xml_config.size());
+    res = xsltApplyStylesheet(cur, doc, params);
+
+    xmlChar *out_ptr = NULL;
+    int xslt_length = 0;
+    int xslt_result = xsltSaveResultToString(&out_ptr, &xslt_length, res, cur);
+
+    if (xslt_result < 0) {
+        std::cerr << "Failed to save converted doc to string" << std::endl;
+
+    }
+
+    std::string xml_result = std::string((char *) out_ptr, xslt_length);
+
+    xmlFree(out_ptr);
+    xmlFreeDoc(res);
+    xmlFreeDoc(doc);
+
+    return xml_result;
+}
+
+std::string readXmlConfig(bool debug_xml, const ParameterMap &parameter_map, uint32_t num_buffers,
+                          std::vector<MeasurementHeaderBuffer> &buffers, std::vector<std::string> &wip_double,
+                          Trajectory &trajectory, long &dwell_time_0, long &max_channels, long &radial_views,
+                          long *global_table_pos, std::string &baseLineString, std::string &protocol_name, std::string& software_version) {
+    dwell_time_0 = 0;
+    max_channels = 0;
+    radial_views = 0;
+    protocol_name = "";
+    std::vector<std::string> wip_long;
+    long center_line = 0;
+    long center_partition = 0;
+    long lPhaseEncodingLines = 0;
+    long iNoOfFourierLines = 0;
+    long lPartitions = 0;
+    long iNoOfFourierPartitions = 0;
+    std::string seqString;
+    for (unsigned int b = 0; b < num_buffers; b++) {
+        if (buffers[b].name.compare("Meas") != 0) continue;
+        if (!buffers[b].loaded) {
+            throw std::runtime_error("Meas buffer has not been loaded");
+        }
+
+
+        std::string config_buffer = std::string(&buffers[b].buf[0], buffers[b].buf.size() - 2);
+        XProtocol::XNode n;
+
+        if (debug_xml) {
+            std::ofstream o("config_buffer.xprot");
+            o.write(config_buffer.c_str(), config_buffer.size());
+        }
+
+        bool is_NX = false;
+        if(config_buffer.find("syngo MR XA11")!=std::string::npos)
+        {
+            is_NX = true;
+        }
+
+        if (ParseXProtocol(config_buffer, n) < 0) {
+            std::stringstream sstream;
+            sstream << "Failed to parse XProtocol for buffer " << buffers[b].name;
+            throw std::runtime_error(sstream.str());
+
+        }
+
+        XProtocol::XNodeIndex index(n);
+
+        //Get some parameters - wip long
+        {
+            const XProtocol::XNode *n2 = index.find("MEAS.sWipMemBlock.alFree");
+            if (n2) {
+                wip_long = apply_visitor(XProtocol::getStringValueArray(), *n2);
+            } else {
+                std::cout << "Search path: MEAS.sWipMemBlock.alFree not found." << std::endl;
+            }
+            if (wip_long.size() == 0) {
+                std::stringstream sstream;
+                sstream << "Failed to find WIP long parameters";
+                throw std::runtime_error(sstream.str());
+
+            }
+        }
+
+        //Get some parameters - wip double
+        {
+            const XProtocol::XNode *n2 = index.find("MEAS.sWipMemBlock.adFree");
+            if (n2) {
+                wip_double = apply_visitor(XProtocol::getStringValueArray(), *n2);
+            } else {
+                std::cout << "Search path: MEAS.sWipMemBlock.adFree not found." << std::endl;
+            }
+            if (wip_double.size() == 0) {
+                std::stringstream sstream;
+                sstream << "Failed to find WIP double parameters";
+                throw std::runtime_error(sstream.str());
+
+            }
+        }
+
+        //Get some parameters - dwell times
+        {
+            const XProtocol::XNode *n2 = index.find("MEAS.sRXSPEC.alDwellTime");
+            std::vector<std::string> temp;
+            if (n2) {
+                temp = apply_visitor(XProtocol::getStringValueArray(), *n2);
+            } else {
+                std::cout << "Search path: MEAS.sWipMemBlock.alFree not found." << std::endl;
+            }
+            if (temp.size() == 0) {
+                std::stringstream sstream;
+                sstream << "Failed to find dwell times";
+                throw std::runtime_error(sstream.str());
+
+            } else {
+                dwell_time_0 = atoi(temp[0].c_str());
+            }
+        }
+
+        //Get some parameters - trajectory
+        {
+            const XProtocol::XNode *n2 = index.find("MEAS.sKSpace.ucTrajectory");
+            std::vector<std::string> temp;
+            if (n2) {
+                temp = apply_visitor(XProtocol::getStringValueArray(), *n2);
+            } else {
+                std::cout << "Search path: MEAS.sKSpace.ucTrajectory not found." << std::endl;
+            }
+            if (temp.size() != 1) {
+                std::stringstream sstream;
+                sstream << "Failed to find appropriate trajectory array";
+                throw std::runtime_error(sstream.str());
+
+            } else {
+
+                int traj = atoi(temp[0].c_str());
+                trajectory = Trajectory(traj);
+                std::cout << "Trajectory is: " << traj << std::endl;
+            }
+        }
+
+        //Get some parameters - max channels
+        {
+            const XProtocol::XNode *n2 = index.find("YAPS.iMaxNoOfRxChannels");
+            std::vector<std::string> temp;
+            if (n2) {
+                temp = apply_visitor(XProtocol::getStringValueArray(), *n2);
+            } else {
+                std::cout << "YAPS.iMaxNoOfRxChannels" << std::endl;
+            }
+            if (temp.size() != 1) {
+                std::stringstream sstream;
+                sstream << "Failed to find YAPS.iMaxNoOfRxChannels array";
+                throw std::runtime_error(sstream.str());
+
+            } else {
+                max_channels = atoi(temp[0].c_str());
+            }
+        }
+
+        //Get some parameters - cartesian encoding bits
+        {
+            // get the center line parameters
+            const XProtocol::XNode *n2 = index.find("MEAS.sKSpace.lPhaseEncodingLines");
+            std::vector<std::string> temp;
+            if (n2) {
+                temp = apply_visitor(XProtocol::getStringValueArray(), *n2);
+            } else {
+                std::cout << "MEAS.sKSpace.lPhaseEncodingLines not found" << std::endl;
+            }
+            if (temp.size() != 1) {
+                std::stringstream sstream;
+                sstream << "Failed to find MEAS.sKSpace.lPhaseEncodingLines array";
+                throw std::runtime_error(sstream.str());
+
+            } else {
+                lPhaseEncodingLines = atoi(temp[0].c_str());
+            }
+
+            n2 = index.find("YAPS.iNoOfFourierLines");
+            if (n2) {
+                temp = apply_visitor(XProtocol::getStringValueArray(), *n2);
+            } else {
+                std::cout << "YAPS.iNoOfFourierLines not found" << std::endl;
+            }
+            if (temp.size() != 1) {
+                std::stringstream sstream;
+                sstream << "Failed to find YAPS.iNoOfFourierLines array";
+                throw std::runtime_error(sstream.str());
+
+            } else {
+                iNoOfFourierLines = atoi(temp[0].c_str());
+            }
+
+            long lFirstFourierLine;
+            bool has_FirstFourierLine = false;
+            n2 = index.find("YAPS.lFirstFourierLine");
+            if (n2) {
+                temp = apply_visitor(XProtocol::getStringValueArray(), *n2);
+            } else {
+                std::cout << "YAPS.lFirstFourierLine not found" << std::endl;
+            }
+            if (temp.size() != 1) {
+                std::cout << "Failed to find YAPS.lFirstFourierLine array" << std::endl;
+                has_FirstFourierLine = false;
+            } else {
+                lFirstFourierLine = atoi(temp[0].c_str());
+                has_FirstFourierLine = true;
+            }
+
+            // get the center partition parameters
+            n2 = index.find("MEAS.sKSpace.lPartitions");
+            if (n2) {
+                temp = apply_visitor(XProtocol::getStringValueArray(), *n2);
+            } else {
+                std::cout << "MEAS.sKSpace.lPartitions not found" << std::endl;
+            }
+            if (temp.size() != 1) {
+                std::stringstream sstream;
+                sstream << "Failed to find MEAS.sKSpace.lPartitions array";
+                throw std::runtime_error(sstream.str());
+
+            } else {
+                lPartitions = atoi(temp[0].c_str());
+            }
+
+            // Note: iNoOfFourierPartitions is sometimes absent for 2D sequences
+            n2 = index.find("YAPS.iNoOfFourierPartitions");
+            if (n2) {
+                temp = apply_visitor(XProtocol::getStringValueArray(), *n2);
+                if (temp.size() != 1) {
+                    iNoOfFourierPartitions = 1;
+                } else {
+                    iNoOfFourierPartitions = atoi(temp[0].c_str());
+                }
+            } else {
+                iNoOfFourierPartitions = 1;
+            }
+
+            long lFirstFourierPartition;
+            bool has_FirstFourierPartition = false;
+            n2 = index.find("YAPS.lFirstFourierPartition");
+            if (n2) {
+                temp = apply_visitor(XProtocol::getStringValueArray(), *n2);
+            } else {
+                std::cout << "YAPS.lFirstFourierPartition not found" << std::endl;
+            }
+            if (temp.size() != 1) {
+                std::cout << "Failed to find YAPS.lFirstFourierPartition array" << std::endl;
+                has_FirstFourierPartition = false;
+            } else {
+                lFirstFourierPartition = atoi(temp[0].c_str());
+                has_FirstFourierPartition = true;
+            }
+
+            // set the values
+            if (has_FirstFourierLine) // bottom half for partial fourier
+            {
+                center_line = lPhaseEncodingLines / 2 - (lPhaseEncodingLines - iNoOfFourierLines);
+            } else {
+                center_line = lPhaseEncodingLines / 2;
+            }
+
+            if (iNoOfFourierPartitions > 1) {
+                // 3D
+                if (has_FirstFourierPartition) // bottom half for partial fourier
+                {
+                    center_partition = lPartitions / 2 - (lPartitions - iNoOfFourierPartitions);
+                } else {
+                    center_partition = lPartitions / 2;
+                }
+            } else {
+                // 2D
+                center_partition = 0;
+            }
+
+            // for spiral sequences the center_line and center_partition are zero
+            if (trajectory == Trajectory::TRAJECTORY_SPIRAL) {
+                center_line = 0;
+                center_partition = 0;
+            }
+
+            std::cout << "center_line = " << center_line << std::endl;
+            std::cout << "center_partition = " << center_partition << std::endl;
+        }
+
+        //Get some parameters - radial views
+        {
+            const XProtocol::XNode *n2 = index.find("MEAS.sKSpace.lRadialViews");
+            std::vector<std::string> temp;
+            if (n2) {
+                temp = apply_visitor(XProtocol::getStringValueArray(), *n2);
+            } else {
+                std::cout << "MEAS.sKSpace.lRadialViews not found" << std::endl;
+            }
+            if (temp.size() != 1) {
+                std::stringstream sstream;
+                sstream << "Failed to find YAPS.MEAS.sKSpace.lRadialViews array";
+                throw std::runtime_error(sstream.str());
+
+            } else {
+                radial_views = atoi(temp[0].c_str());
+            }
+        }
+            //Get some parameters - global table position
+            {
+                const XProtocol::XNode* n2 = index.find("DICOM.lGlobalTablePosSag");
+                std::vector<std::string> temp;
+                if (n2) {
+                    temp = apply_visitor(XProtocol::getStringValueArray(), *n2);
+                    if (temp.size() != 1)
+                    {
+                        global_table_pos[0] = 0;
+                    }
+                    else
+                    {
+                        global_table_pos[0] = atol(temp[0].c_str());
+                    }
+                }
+                else {
+                    std::cout << "DICOM.lGlobalTablePosSag not found" << std::endl;
+                    global_table_pos[0] = 0;
+                }
+
+        n2 = index.find("DICOM.lGlobalTablePosCor");
+                if (n2) {
+                    temp = apply_visitor(XProtocol::getStringValueArray(), *n2);
+                    if (temp.size() != 1)
+                    {
+                        global_table_pos[1] = 0;
+                    }
+                    else
+                    {
+                        global_table_pos[1] = atol(temp[0].c_str());
+                    }
+                }
+                else {
+                    std::cout << "DICOM.lGlobalTablePosCor not found" << std::endl;
+                    global_table_pos[1] = 0;
+                }
+
+                n2 = index.find("DICOM.lGlobalTablePosTra");
+                if (n2) {
+                    temp = apply_visitor(XProtocol::getStringValueArray(), *n2);
+                    if (temp.size() != 1)
+                    {
+                        global_table_pos[2] = 0;
+                    }
+                    else
+                    {
+                        global_table_pos[2] = atol(temp[0].c_str());
+                    }
+                }
+                else {
+                    std::cout << "DICOM.lGlobalTablePosTra not found" << std::endl;
+                    global_table_pos[2] = 0;
+                }
+            }//Get some parameters - protocol name
+        {
+            const XProtocol::XNode *n2 = index.find("HEADER.tProtocolName");
+            std::vector<std::string> temp;
+            if (n2) {
+                temp = apply_visitor(XProtocol::getStringValueArray(), *n2);
+            } else {
+                std::cout << "HEADER.tProtocolName not found" << std::endl;
+            }
+            if (temp.size() != 1) {
+                std::stringstream sstream;
+                sstream << "Failed to find HEADER.tProtocolName";
+                throw std::runtime_error(sstream.str());
+
+            } else {
+                protocol_name = temp[0];
+            }
+        }
+
+        // Get some parameters - base line
+        {
+            const XProtocol::XNode *n2 = index.find("MEAS.sProtConsistencyInfo.tBaselineString");
+            std::vector<std::string> temp;
+            if (n2) {
+                temp = apply_visitor(XProtocol::getStringValueArray(), *n2);
+            }
+            if (temp.size() > 0) {
+                baseLineString = temp[0];
+            }
+        }
+
+        if (baseLineString.empty()) {
+            const XProtocol::XNode *n2 = index.find("MEAS.sProtConsistencyInfo.tMeasuredBaselineString");
+            std::vector<std::string> temp;
+            if (n2) {
+                temp = apply_visitor(XProtocol::getStringValueArray(), *n2);
+            }
+            if (temp.size() > 0) {
+                baseLineString = temp[0];
+            }
+        }
+
+        if (baseLineString.empty()) {
+            std::cout << "Failed to find MEAS.sProtConsistencyInfo.tBaselineString/tMeasuredBaselineString"
+                      << std::endl;
+        }
+
+        // Get software version
+        {
+            const XProtocol::XNode* n2 = index.find("Dicom.SoftwareVersions");
+            std::vector<std::string> temp;
+            if (n2) {
+                temp = apply_visitor(XProtocol::getStringValueArray(), *n2);
+            }
+            if (temp.size() > 0) {
+                software_version = temp[0];
+            }
+        }
+
+        //xml_config = ProcessParameterMap(n, parammap_file);
+        return ProcessParameterMap(index, parameter_map);
+
+
+    }
+    throw std::runtime_error("No Meas buffer found in Siemens dataset");
+}
+
+std::vector<MeasurementHeaderBuffer> readMeasurementHeaderBuffers(DatReader &siemens_dat, uint32_t num_buffers) {
+    auto buffers = std::vector<MeasurementHeaderBuffer>(num_buffers);
+
+    std::cout << "Number of parameter buffers: " << num_buffers << std::endl;
+
+    for (int b = 0; b < num_buffers; b++) {
+        buffers[b].name = siemens_dat.read_string(32);
+        std::cout << "Buffer Name: " << buffers[b].name << std::endl;
+        uint32_t buflen = 0;
+        if (!siemens_dat.read(buflen)) {
+            break;
+        }
+        buffers[b].offset = siemens_dat.tell();
+        buffers[b].length = buflen;
+        siemens_dat.skip(buflen);
+    }
+    return buffers;
+}
+
+void loadMeasurementHeaderBuffers(DatReader &siemens_dat, std::vector<MeasurementHeaderBuffer> &buffers,
+                                  const char *name) {
+    uint64_t position = siemens_dat.tell();
+
+    for (size_t b = 0; b < buffers.size(); b++) {
+        if (buffers[b].loaded || (name && buffers[b].name != name)) {
+            continue;
+        }
+
+        siemens_dat.seek(buffers[b].offset);
+        const char *bytebuf = siemens_dat.view(buffers[b].length);
+        if (!bytebuf) {
+            std::stringstream sstream;
+            sstream << "Measurement header buffer " << buffers[b].name << " is truncated";
+            throw std::runtime_error(sstream.str());
+        }
+
+        // The buffers are ASCII apart from the odd comment or protocol name, only the part from the
+        // first other byte on is decoded. ASCII is never part of a multi byte sequence, so the split is safe.
+        size_t buflen = buffers[b].length;
+        size_t ascii = asciiPrefixLength(bytebuf, buflen);
+        buffers[b].buf.assign(bytebuf, ascii);
+        if (ascii < buflen) {
+            buffers[b].buf += ws2s(utf_to_utf<wchar_t>(bytebuf + ascii, bytebuf + buflen));
+        }
+        buffers[b].loaded = true;
+    }
+
+    siemens_dat.seek(position);
+}
+
+std::vector<MrParcRaidFileEntry>
+readParcFileEntries(DatReader &siemens_dat, const MrParcRaidFileHeader &ParcRaidHead, bool VBFILE) {
+    std::vector<MrParcRaidFileEntry> ParcFileEntries(64);
+
+    if (VBFILE) {
+        std::cout << "VB line file detected." << std::endl;
+        //In case of VB file, we are just going to fill these with zeros. It doesn't exist.
+        for (unsigned int i = 0; i < 64; i++) {
+            memset(&ParcFileEntries[i], 0, sizeof(MrParcRaidFileEntry));
+        }
+
+        ParcFileEntries[0].off_ = 0;
+        ParcFileEntries[0].len_ = siemens_dat.size(); //This is the whole size of the dat file
+        siemens_dat.seek(0); //Rewind a bit, we have no raid file header.
+
+        std::cout << "Protocol name: " << ParcFileEntries[0].protName_ << std::endl; // blank
+    } else {
+        std::cout << "VD line file detected." << std::endl;
+        for (unsigned int i = 0; i < 64; i++) {
+            siemens_dat.read(ParcFileEntries[i]);
+
+            if (i < ParcRaidHead.count_) {
+                std::cout << "Protocol name [" << i+1 << "]: " << ParcFileEntries[i].protName_ << std::endl;
+            }
+        }
+    }
+    return ParcFileEntries;
+}
+
+std::string get_file_content(const std::string &file) {
+
+    try {
+        return load_file(file);
+    }
+    catch (...) {}
+
+    try {
+        return load_embedded(file);
+    }
+    catch (...) {}
+
+    throw std::runtime_error("Failed to load file: " + file);
+}
+
+std::string select_file(
+        const std::string &file,
+        const std::string &default_file,
+        const bool all_measurements,
+        const unsigned int currentMeas) {
+
+    if (file.empty()) return default_file;
+
+    std::vector<std::string> files;
+    boost::algorithm::split(files, file, boost::is_any_of(","));
+
+    if (!all_measurements) return file;
+    if (files.size() == 1) return file;
+
+    try {
+        const std::string &file_token = files.at(currentMeas - 1);
+        return file_token.empty() ? default_file : file_token;
+    }
+    catch (const std::out_of_range &e) {
+        std::stringstream message;
+        message << "Multiple files provided (" << file << "), but the current measurement (" << currentMeas << ") exceeds the number specified.";
+        throw std::runtime_error(message.str());
+    }
+}
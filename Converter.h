@@ -0,0 +1,140 @@
+#ifndef CONVERTER_H_
+#define CONVERTER_H_
+
+#include "siemensraw.h"
+#include "DatReader.h"
+#include "DatIndex.h"
+#include "XNode.h"
+#include "EmbeddedFiles.h"
+#include "TrajectoryCache.h"
+
+#include "ismrmrd/ismrmrd.h"
+#include "ismrmrd/xml.h"
+
+#include <boost/shared_ptr.hpp>
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+/// Building blocks of the conversion, shared by MeasurementReader and the siemens_to_ismrmrd tool.
+
+const size_t MYSTERY_BYTES_EXPECTED = 160;
+
+// libxml2/libxslt keep global state, measurements converted concurrently take turns using them
+extern std::mutex xml_mutex;
+
+// Settings shared by the conversion of all measurements of a file
+struct ConversionSettings
+{
+    ConversionSettings();
+
+    std::string siemens_dat_filename;
+    std::string parammap_file;
+    std::string parammap_xsl;
+    std::string schema_file_name_content;
+    std::string study_date_user_supplied;
+    bool debug_xml;
+    bool flash_pat_ref_scan;
+    bool header_only;
+    bool append_buffers;
+    bool all_measurements;
+    bool skip_syncdata;
+    bool skip_validation;
+    bool attachTrajectory;
+    std::string trajectory_cache_dir;
+    unsigned int writer_queue_depth;
+    unsigned int writer_batch_size;
+    unsigned int writer_batch_mb;
+    std::string stream_target;
+    double follow_timeout;
+    bool VBFILE;
+    MrParcRaidFileHeader ParcRaidHead;
+    std::vector<MrParcRaidFileEntry> ParcFileEntries;
+};
+
+// Reads the raid file header and the measurement table into settings (VBFILE, ParcRaidHead, ParcFileEntries)
+// and loads the embedded ISMRMRD schema. Returns false if the file layout is not supported.
+bool readFileLayout(DatReader &siemens_dat, ConversionSettings &settings);
+
+// One protocol buffer of the measurement header. readMeasurementHeaderBuffers only records where it is,
+// buf is filled by loadMeasurementHeaderBuffers.
+struct MeasurementHeaderBuffer
+{
+    MeasurementHeaderBuffer() : offset(0), length(0), loaded(false) {}
+
+    std::string name;
+    uint64_t offset; // File position of the contents
+    uint32_t length;
+    bool loaded;
+    std::string buf;
+};
+
+// One <p> of the parameter map, with its source path already split into the node path and an optional value index
+struct ParameterMapEntry
+{
+    std::string search_path;
+    int index;
+    std::string destination;
+};
+
+// Parameter map XML compiled into the list of parameters to copy
+struct ParameterMap
+{
+    bool valid;
+    std::vector<ParameterMapEntry> entries;
+};
+
+ParameterMap parseParameterMap(const std::string &mapfile);
+boost::shared_ptr<const ParameterMap> compileParameterMap(const std::string &mapfile);
+
+// Contents of an embedded file, throws std::runtime_error if there is none with this name
+std::string load_embedded(std::string name);
+std::string load_file(std::string file_name);
+std::string get_file_content(const std::string &file);
+std::string select_file(const std::string &file, const std::string &default_file, bool all_measurements,
+                        unsigned int currentMeas);
+
+std::string get_date_time_string();
+std::string get_time_string(size_t hours, size_t mins, size_t secs);
+
+// Must be called with xml_mutex held
+int xml_file_is_valid(const std::string &xml, const std::string &schema_file);
+std::string parseXML(bool debug_xml, const std::string &parammap_xsl_content, const std::string xml_config);
+
+bool fill_ismrmrd_header(ISMRMRD::IsmrmrdHeader &h, const std::string &study_date, const std::string &study_time);
+void append_buffers_to_xml_header(std::vector<MeasurementHeaderBuffer> &buffers, size_t num_buffers,
+                                  ISMRMRD::IsmrmrdHeader &header);
+
+std::vector<MrParcRaidFileEntry>
+readParcFileEntries(DatReader &siemens_dat, const MrParcRaidFileHeader &ParcRaidHead, bool VBFILE);
+
+// Reads the names and positions of the buffers and skips their contents
+std::vector<MeasurementHeaderBuffer> readMeasurementHeaderBuffers(DatReader &siemens_dat, uint32_t num_buffers);
+
+// Reads the contents of the buffers called name, or of all buffers if name is NULL. Buffers that are already
+// loaded are kept, the position of siemens_dat is restored. Throws std::runtime_error if a buffer is truncated.
+void loadMeasurementHeaderBuffers(DatReader &siemens_dat, std::vector<MeasurementHeaderBuffer> &buffers,
+                                  const char *name = NULL);
+
+std::string readXmlConfig(bool debug_xml, const ParameterMap &parameter_map, uint32_t num_buffers,
+                          std::vector<MeasurementHeaderBuffer> &buffers, std::vector<std::string> &wip_double,
+                          Trajectory &trajectory, long &dwell_time_0, long &max_channels, long &radial_views, long* global_table_pos,
+                          std::string &baseLine_string, std::string &protocol_name, std::string& software_version);
+
+void readScanHeader(DatReader &siemens_dat, bool VBFILE, sMDH &mdh, sScanHeader &scanhead);
+
+void readChannelData(DatReader &siemens_dat, bool VBFILE, const sScanHeader &scanhead, complex_float_t *data);
+
+void
+getAcquisition(bool flash_pat_ref_scan, const Trajectory &trajectory, long dwell_time_0, long* global_table_pos, long max_channels,
+               bool isAdjustCoilSens, bool isAdjQuietCoilSens, bool isVB, bool isNX, const SpiralTrajectory *traj,
+               const sScanHeader &scanhead, DatReader &siemens_dat, bool VBFILE, ISMRMRD::Acquisition &ismrmrd_acq);
+
+std::vector<ISMRMRD::Waveform> readSyncdata(DatReader &siemens_dat, bool VBFILE, unsigned long acquisitions,
+                                            uint32_t dma_length, sScanHeader scanheader, ISMRMRD::IsmrmrdHeader &header,
+                                            long scan_counter, bool skip_syncdata);
+
+MeasurementIndex indexMeasurement(DatReader &siemens_dat, bool VBFILE, const MrParcRaidFileEntry &entry, unsigned int number);
+
+#endif //CONVERTER_H_
@@ -0,0 +1,153 @@
+#include "DatIndex.h"
+
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <cstdio>
+#include <stdexcept>
+
+MeasurementIndex::MeasurementIndex()
+    : number(0)
+    , meas_id(0)
+    , file_id(0)
+    , offset(0)
+    , length(0)
+    , data_offset(0)
+    , end_offset(0)
+    , scans(0)
+    , acquisitions(0)
+    , complex_samples(0)
+    , sync_packets(0)
+    , pmu_packets(0)
+    , acqend(false)
+{
+}
+
+DatIndex::DatIndex()
+    : file_size(0)
+    , vb_file(false)
+{
+}
+
+// JSON string of s. Bytes >= 0x80 are copied as they are, so UTF-8 text (e.g. a file name on Linux
+// or macOS) stays UTF-8. With latin1 they are escaped instead: Siemens strings are Latin-1, which maps
+// 1:1 to the first 256 unicode code points.
+static std::string json_string(const std::string &s, bool latin1 = false)
+{
+    std::string ret = "\"";
+    for (size_t i = 0; i < s.size(); i++) {
+        unsigned char c = s[i];
+        if (c == '"' || c == '\\') {
+            ret += '\\';
+            ret += c;
+        } else if (c < 0x20 || c == 0x7f || (latin1 && c >= 0x80)) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            ret += buf;
+        } else {
+            ret += c;
+        }
+    }
+    return ret + "\"";
+}
+
+static void write_histogram(std::ostream &os, const char *name, const std::map<unsigned int, unsigned long> &histogram)
+{
+    os << "      " << json_string(name) << ": {";
+    std::map<unsigned int, unsigned long>::const_iterator it;
+    for (it = histogram.begin(); it != histogram.end(); ++it) {
+        if (it != histogram.begin()) {
+            os << ", ";
+        }
+        os << "\"" << it->first << "\": " << it->second;
+    }
+    os << "}";
+}
+
+void writeDatIndex(const DatIndex &index, std::ostream &os)
+{
+    os << "{\n";
+    os << "  \"file\": " << json_string(index.filename) << ",\n";
+    os << "  \"file_size\": " << index.file_size << ",\n";
+    os << "  \"vb_file\": " << (index.vb_file ? "true" : "false") << ",\n";
+    os << "  \"measurements\": [";
+    for (size_t i = 0; i < index.measurements.size(); i++) {
+        const MeasurementIndex &m = index.measurements[i];
+        os << (i ? ",\n" : "\n") << "    {\n";
+        os << "      \"number\": " << m.number << ",\n";
+        os << "      \"meas_id\": " << m.meas_id << ",\n";
+        os << "      \"file_id\": " << m.file_id << ",\n";
+        os << "      \"protocol_name\": " << json_string(m.protocol_name, true) << ",\n";
+        os << "      \"offset\": " << m.offset << ",\n";
+        os << "      \"length\": " << m.length << ",\n";
+        os << "      \"data_offset\": " << m.data_offset << ",\n";
+        os << "      \"end_offset\": " << m.end_offset << ",\n";
+        os << "      \"scans\": " << m.scans << ",\n";
+        os << "      \"acquisitions\": " << m.acquisitions << ",\n";
+        os << "      \"complex_samples\": " << m.complex_samples << ",\n";
+        os << "      \"sync_packets\": " << m.sync_packets << ",\n";
+        os << "      \"pmu_packets\": " << m.pmu_packets << ",\n";
+        os << "      \"acqend\": " << (m.acqend ? "true" : "false") << ",\n";
+        write_histogram(os, "eval_info_mask_bits", m.eval_info_mask_bits);
+        os << ",\n";
+        write_histogram(os, "channels", m.channels);
+        os << ",\n";
+        write_histogram(os, "samples", m.samples);
+        os << "\n    }";
+    }
+    os << "\n  ]\n}\n";
+}
+
+static void read_histogram(const boost::property_tree::ptree &node, std::map<unsigned int, unsigned long> &histogram)
+{
+    boost::property_tree::ptree::const_iterator it;
+    for (it = node.begin(); it != node.end(); ++it) {
+        histogram[boost::lexical_cast<unsigned int>(it->first)] = it->second.get_value<unsigned long>();
+    }
+}
+
+DatIndex readDatIndex(const std::string &filename)
+{
+    namespace pt = boost::property_tree;
+
+    DatIndex index;
+    try {
+        pt::ptree root;
+        pt::read_json(filename, root);
+
+        index.filename = root.get<std::string>("file");
+        index.file_size = root.get<uint64_t>("file_size");
+        index.vb_file = root.get<bool>("vb_file");
+
+        const pt::ptree &measurements = root.get_child("measurements");
+        pt::ptree::const_iterator it;
+        for (it = measurements.begin(); it != measurements.end(); ++it) {
+            const pt::ptree &node = it->second;
+            MeasurementIndex m;
+            m.number = node.get<unsigned int>("number");
+            m.meas_id = node.get<uint32_t>("meas_id");
+            m.file_id = node.get<uint32_t>("file_id");
+            m.protocol_name = node.get<std::string>("protocol_name");
+            m.offset = node.get<uint64_t>("offset");
+            m.length = node.get<uint64_t>("length");
+            m.data_offset = node.get<uint64_t>("data_offset");
+            m.end_offset = node.get<uint64_t>("end_offset");
+            m.scans = node.get<unsigned long>("scans");
+            m.acquisitions = node.get<unsigned long>("acquisitions");
+            m.complex_samples = node.get<uint64_t>("complex_samples");
+            m.sync_packets = node.get<unsigned long>("sync_packets");
+            m.pmu_packets = node.get<unsigned long>("pmu_packets");
+            m.acqend = node.get<bool>("acqend");
+            read_histogram(node.get_child("eval_info_mask_bits"), m.eval_info_mask_bits);
+            read_histogram(node.get_child("channels"), m.channels);
+            read_histogram(node.get_child("samples"), m.samples);
+            index.measurements.push_back(m);
+        }
+    }
+    catch (const std::exception &e) {
+        throw std::runtime_error("Failed to read index file " + filename + ": " + e.what());
+    }
+
+    return index;
+}
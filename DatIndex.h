@@ -0,0 +1,54 @@
+#ifndef DATINDEX_H_
+#define DATINDEX_H_
+
+#include <stdint.h>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/// Summary of one measurement of a .dat file, collected by walking the scan headers only
+struct MeasurementIndex
+{
+    MeasurementIndex();
+
+    unsigned int number;        // 1 based, as used by --measNum
+    uint32_t meas_id;
+    uint32_t file_id;
+    std::string protocol_name;
+
+    uint64_t offset;            // MrParcRaidFileEntry::off_
+    uint64_t length;            // MrParcRaidFileEntry::len_
+    uint64_t data_offset;       // First scan header, after the measurement header buffers
+    uint64_t end_offset;        // Position after the last scan that was walked
+
+    unsigned long scans;        // All scan headers, including syncdata and ACQEND
+    unsigned long acquisitions; // Scans that are converted to ISMRMRD acquisitions
+    uint64_t complex_samples;   // Sum of channels * samples over all acquisitions
+    unsigned long sync_packets;
+    unsigned long pmu_packets;
+    bool acqend;                // Whether the ACQEND scan was found
+
+    std::map<unsigned int, unsigned long> eval_info_mask_bits; // Bit number -> number of scans with the bit set
+    std::map<unsigned int, unsigned long> channels;            // Used channels -> number of scans
+    std::map<unsigned int, unsigned long> samples;             // Samples in scan -> number of scans
+};
+
+/// Table of contents of a .dat file, written by --index and read back by --useIndex
+struct DatIndex
+{
+    DatIndex();
+
+    std::string filename;
+    uint64_t file_size;
+    bool vb_file;
+    std::vector<MeasurementIndex> measurements;
+};
+
+/// Writes the index as JSON
+void writeDatIndex(const DatIndex &index, std::ostream &os);
+
+/// Reads an index written by writeDatIndex. Throws std::runtime_error if the file can not be parsed.
+DatIndex readDatIndex(const std::string &filename);
+
+#endif //DATINDEX_H_
@@ -0,0 +1,179 @@
+#include "DatReader.h"
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/filesystem.hpp>
+
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+namespace bip = boost::interprocess;
+
+// Buffer used by the std::ifstream fallback, large enough to keep the number of read syscalls low
+const size_t STREAM_BUFFER_SIZE = 4 * 1024 * 1024;
+
+// How often a growing file is checked for new data
+const std::chrono::milliseconds FOLLOW_POLL_INTERVAL(20);
+
+DatReader::DatReader(const std::string &filename, bool use_mmap, double follow_timeout)
+    : mapped_data_(NULL)
+    , stream_pos_(0)
+    , filename_(filename)
+    , follow_timeout_(follow_timeout)
+    , size_(0)
+    , pos_(0)
+    , open_(false)
+    , good_(true)
+{
+    // A mapping would not see the data written after it was created
+    if (use_mmap && follow_timeout_ <= 0) {
+        try {
+            mapping_.reset(new bip::file_mapping(filename.c_str(), bip::read_only));
+            region_.reset(new bip::mapped_region(*mapping_, bip::read_only));
+            region_->advise(bip::mapped_region::advice_sequential);
+            mapped_data_ = static_cast<const char *>(region_->get_address());
+            size_ = region_->get_size();
+            open_ = true;
+            return;
+        }
+        catch (const bip::interprocess_exception &) {
+            // Empty files and files larger than the address space can not be mapped
+            region_.reset();
+            mapping_.reset();
+        }
+    }
+
+    stream_buffer_.resize(STREAM_BUFFER_SIZE);
+    stream_.rdbuf()->pubsetbuf(&stream_buffer_[0], stream_buffer_.size());
+    stream_.open(filename.c_str(), std::ios::in | std::ios::binary);
+    if (stream_) {
+        stream_.seekg(0, std::ios::end);
+        size_ = stream_.tellg();
+        stream_.seekg(0, std::ios::beg);
+        open_ = true;
+    }
+}
+
+DatReader::~DatReader()
+{
+}
+
+void DatReader::seek(uint64_t pos)
+{
+    pos_ = pos;
+}
+
+void DatReader::skip(int64_t offset)
+{
+    pos_ += offset;
+}
+
+// Waits until the file is at least end bytes long, or has not grown for follow_timeout_ seconds
+void DatReader::wait_for(uint64_t end)
+{
+    std::chrono::steady_clock::time_point last_growth = std::chrono::steady_clock::now();
+    while (size_ < end) {
+        boost::system::error_code ec;
+        uint64_t size = boost::filesystem::file_size(filename_, ec);
+        if (!ec && size > size_) {
+            size_ = size;
+            last_growth = std::chrono::steady_clock::now();
+            continue;
+        }
+        if (std::chrono::duration<double>(std::chrono::steady_clock::now() - last_growth).count() > follow_timeout_) {
+            return;
+        }
+        std::this_thread::sleep_for(FOLLOW_POLL_INTERVAL);
+    }
+}
+
+bool DatReader::available(size_t len)
+{
+    if (good_ && follow_timeout_ > 0 && pos_ + len > size_) {
+        wait_for(pos_ + len);
+    }
+    if (!good_ || pos_ > size_ || size_ - pos_ < len) {
+        good_ = false;
+        return false;
+    }
+    return true;
+}
+
+bool DatReader::stream_read(char *dst, size_t len)
+{
+    if (pos_ > stream_pos_ && pos_ - stream_pos_ <= STREAM_BUFFER_SIZE) {
+        // Short forward skips (e.g. over channel headers) are served from the stream buffer
+        stream_.ignore(pos_ - stream_pos_);
+        stream_pos_ = pos_;
+    }
+    if (stream_pos_ != pos_) {
+        // Also after a failed read (stream_pos_ is then past the end), e.g. at the old end of a growing file
+        stream_.clear();
+        stream_.seekg(pos_, std::ios::beg);
+    }
+    stream_.read(dst, len);
+    if (!stream_) {
+        good_ = false;
+        stream_pos_ = size_ + 1; // Force a seek on the next read
+        return false;
+    }
+    pos_ += len;
+    stream_pos_ = pos_;
+    return true;
+}
+
+bool DatReader::read(void *dst, size_t len)
+{
+    if (!available(len)) {
+        return false;
+    }
+
+    if (mapped_data_) {
+        memcpy(dst, mapped_data_ + pos_, len);
+        pos_ += len;
+        return true;
+    }
+
+    return stream_read(static_cast<char *>(dst), len);
+}
+
+const char *DatReader::view(size_t len)
+{
+    if (!available(len)) {
+        return NULL;
+    }
+
+    if (mapped_data_) {
+        const char *ptr = mapped_data_ + pos_;
+        pos_ += len;
+        return ptr;
+    }
+
+    if (view_buffer_.size() < len + 1) {
+        view_buffer_.resize(len + 1);
+    }
+    if (!stream_read(&view_buffer_[0], len)) {
+        return NULL;
+    }
+    return &view_buffer_[0];
+}
+
+std::string DatReader::read_string(size_t max_len)
+{
+    std::string ret;
+    char c;
+    while (ret.size() + 1 < max_len) {
+        if (!read(&c, 1)) {
+            return ret;
+        }
+        if (c == '\0') {
+            return ret;
+        }
+        ret += c;
+    }
+
+    // No terminator within max_len characters
+    good_ = false;
+    return ret;
+}
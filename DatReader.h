@@ -0,0 +1,92 @@
+#ifndef DATREADER_H_
+#define DATREADER_H_
+
+#include <stdint.h>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <boost/scoped_ptr.hpp>
+
+namespace boost {
+namespace interprocess {
+class file_mapping;
+class mapped_region;
+}
+}
+
+/// Random access reader for Siemens .dat files.
+///
+/// The whole file is memory mapped when possible. In that case view() returns pointers
+/// straight into the mapping, which stay valid for the lifetime of the reader.
+/// If the file cannot be mapped (e.g. not enough address space on 32 bit systems),
+/// the reader falls back to buffered std::ifstream reads and view() returns a pointer
+/// into an internal buffer, which is only valid until the next call to view().
+///
+/// The position is tracked by the reader itself, so tell() never touches the file.
+/// Reading past the end of the file clears the good() state, like a std::istream would.
+///
+/// With a follow timeout > 0 the file may still be growing (e.g. while it is being copied).
+/// It is then read through the stream, and a read past the current end waits for the data
+/// to be written. Only if the file has not grown for follow_timeout seconds does the read fail.
+/// size() is the size seen so far.
+class DatReader
+{
+public:
+    explicit DatReader(const std::string &filename, bool use_mmap = true, double follow_timeout = 0);
+    ~DatReader();
+
+    bool is_open() const { return open_; }
+    bool is_mapped() const { return mapped_data_ != NULL; }
+
+    bool good() const { return good_; }
+    bool operator!() const { return !good_; }
+    void clear() { good_ = true; }
+
+    uint64_t size() const { return size_; }
+    uint64_t tell() const { return pos_; }
+    void seek(uint64_t pos);
+    void skip(int64_t offset);
+
+    /// Copies len bytes at the current position to dst and advances the position
+    bool read(void *dst, size_t len);
+
+    template <typename T> bool read(T &value)
+    {
+        return read(&value, sizeof(T));
+    }
+
+    /// Returns a pointer to len bytes at the current position and advances the position.
+    /// Returns NULL (and clears good()) if fewer than len bytes are left.
+    const char *view(size_t len);
+
+    /// Reads a '\0' terminated string of at most max_len - 1 characters (like istream::getline)
+    std::string read_string(size_t max_len);
+
+private:
+    DatReader(const DatReader &);
+    DatReader &operator=(const DatReader &);
+
+    bool available(size_t len);
+    void wait_for(uint64_t end);
+    bool stream_read(char *dst, size_t len);
+
+    boost::scoped_ptr<boost::interprocess::file_mapping> mapping_;
+    boost::scoped_ptr<boost::interprocess::mapped_region> region_;
+    const char *mapped_data_;
+
+    std::ifstream stream_;
+    std::vector<char> stream_buffer_;
+    std::vector<char> view_buffer_;
+    uint64_t stream_pos_;
+
+    std::string filename_;
+    double follow_timeout_;
+
+    uint64_t size_;
+    uint64_t pos_;
+    bool open_;
+    bool good_;
+};
+
+#endif //DATREADER_H_
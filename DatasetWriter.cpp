@@ -0,0 +1,235 @@
+#include "DatasetWriter.h"
+
+#include <chrono>
+#include <stdexcept>
+
+typedef std::chrono::steady_clock Clock;
+
+static double seconds_since(const Clock::time_point &start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Wait used while the queue is full (producer) or empty (writer)
+static void backoff(unsigned int &spins)
+{
+    if (++spins < 64) {
+        std::this_thread::yield();
+    } else {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+}
+
+DatasetWriter::DatasetWriter(boost::shared_ptr<BatchedDataset> dataset, size_t queue_depth, size_t batch_size,
+                             size_t batch_bytes, boost::shared_ptr<AcquisitionPool> pool)
+    : dataset_(dataset)
+    , pool_(pool)
+    , batch_size_(batch_size)
+    , batch_bytes_(batch_bytes)
+    , pending_bytes_(0)
+    , done_(false)
+    , failed_(false)
+    , closed_(false)
+    , acquisitions_(0)
+    , waveforms_(0)
+    , batches_(0)
+    , busy_seconds_(0)
+    , stalled_seconds_(0)
+    , producer_stalled_seconds_(0)
+{
+    if (batch_size_ > 1) {
+        batch_.reserve(batch_size_);
+        dataset_->reserve(batch_size_);
+    }
+    if (queue_depth > 0) {
+        queue_.reset(new boost::lockfree::spsc_queue<QueueItem>(queue_depth));
+        thread_ = std::thread(&DatasetWriter::run, this);
+    }
+}
+
+DatasetWriter::~DatasetWriter()
+{
+    try {
+        close();
+    }
+    catch (...) {
+    }
+    for (size_t i = 0; i < batch_.size(); i++) {
+        delete batch_[i];
+    }
+}
+
+void DatasetWriter::appendAcquisition(std::unique_ptr<ISMRMRD::Acquisition> acq)
+{
+    QueueItem item = {acq.release(), NULL};
+    push(item);
+}
+
+void DatasetWriter::appendWaveform(std::unique_ptr<ISMRMRD::Waveform> wav)
+{
+    QueueItem item = {NULL, wav.release()};
+    push(item);
+}
+
+void DatasetWriter::push(const QueueItem &item)
+{
+    if (!queue_) {
+        write(item);
+        return;
+    }
+
+    if (failed_) {
+        delete item.acq;
+        delete item.wav;
+        throw std::runtime_error("HDF5 writer thread failed: " + error_);
+    }
+
+    if (!queue_->push(item)) {
+        Clock::time_point start = Clock::now();
+        unsigned int spins = 0;
+        while (!queue_->push(item)) {
+            backoff(spins);
+        }
+        producer_stalled_seconds_ += seconds_since(start);
+    }
+}
+
+void DatasetWriter::write(const QueueItem &item)
+{
+    // Take ownership, so the item is freed even if HDF5 throws
+    std::unique_ptr<ISMRMRD::Acquisition> acq(item.acq);
+    std::unique_ptr<ISMRMRD::Waveform> wav(item.wav);
+
+    Clock::time_point start = Clock::now();
+    if (acq) {
+        if (batch_size_ > 1) {
+            pending_bytes_ += acq->getDataSize() + acq->getTrajSize();
+            batch_.push_back(acq.release());
+            if (batch_.size() >= batch_size_ || (batch_bytes_ > 0 && pending_bytes_ >= batch_bytes_)) {
+                flush();
+            }
+        } else {
+            std::lock_guard<std::mutex> lock(hdf5_mutex());
+            dataset_->appendAcquisition(*acq);
+            acquisitions_++;
+            batches_++;
+            release(std::move(acq));
+        }
+    }
+    if (wav) {
+        std::lock_guard<std::mutex> lock(hdf5_mutex());
+        dataset_->appendWaveform(*wav);
+        waveforms_++;
+    }
+    busy_seconds_ += seconds_since(start);
+}
+
+void DatasetWriter::flush()
+{
+    if (batch_.empty()) {
+        return;
+    }
+
+    try {
+        std::lock_guard<std::mutex> lock(hdf5_mutex());
+        dataset_->appendAcquisitions(batch_);
+    }
+    catch (...) {
+        for (size_t i = 0; i < batch_.size(); i++) {
+            delete batch_[i];
+        }
+        batch_.clear();
+        pending_bytes_ = 0;
+        throw;
+    }
+
+    acquisitions_ += batch_.size();
+    batches_++;
+    for (size_t i = 0; i < batch_.size(); i++) {
+        release(std::unique_ptr<ISMRMRD::Acquisition>(batch_[i]));
+    }
+    batch_.clear();
+    pending_bytes_ = 0;
+}
+
+void DatasetWriter::release(std::unique_ptr<ISMRMRD::Acquisition> acq)
+{
+    if (pool_) {
+        pool_->recycle(std::move(acq));
+    }
+}
+
+void DatasetWriter::run()
+{
+    QueueItem item;
+    for (;;) {
+        if (queue_->pop(item)) {
+            if (failed_) {
+                delete item.acq;
+                delete item.wav;
+                continue;
+            }
+            try {
+                write(item);
+            }
+            catch (const std::exception &e) {
+                error_ = e.what();
+                failed_ = true;
+            }
+            continue;
+        }
+
+        if (done_ && queue_->read_available() == 0) {
+            if (!failed_) {
+                try {
+                    Clock::time_point start = Clock::now();
+                    flush();
+                    busy_seconds_ += seconds_since(start);
+                }
+                catch (const std::exception &e) {
+                    error_ = e.what();
+                    failed_ = true;
+                }
+            }
+            break;
+        }
+
+        Clock::time_point start = Clock::now();
+        unsigned int spins = 0;
+        while (!queue_->read_available() && !done_) {
+            backoff(spins);
+        }
+        stalled_seconds_ += seconds_since(start);
+    }
+}
+
+void DatasetWriter::close()
+{
+    if (closed_) {
+        return;
+    }
+    closed_ = true;
+
+    if (queue_) {
+        done_ = true;
+        thread_.join();
+        if (failed_) {
+            throw std::runtime_error("HDF5 writer thread failed: " + error_);
+        }
+    } else {
+        Clock::time_point start = Clock::now();
+        flush();
+        busy_seconds_ += seconds_since(start);
+    }
+}
+
+void DatasetWriter::printStatistics(std::ostream &os) const
+{
+    os << "HDF5 writer: " << acquisitions_ << " acquisitions in " << batches_ << " writes, " << waveforms_
+       << " waveforms, busy " << busy_seconds_ << " s";
+    if (queue_) {
+        os << ", stalled " << stalled_seconds_ << " s waiting for data"
+           << ", parser stalled " << producer_stalled_seconds_ << " s on a full queue";
+    }
+    os << std::endl;
+}
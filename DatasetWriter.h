@@ -0,0 +1,89 @@
+#ifndef DATASETWRITER_H_
+#define DATASETWRITER_H_
+
+#include "ismrmrd/ismrmrd.h"
+#include "BatchedDataset.h"
+#include "AcquisitionPool.h"
+
+#include <boost/shared_ptr.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/lockfree/spsc_queue.hpp>
+
+#include <atomic>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/// Appends acquisitions and waveforms to an ISMRMRD::Dataset.
+///
+/// Acquisitions are collected into batches of up to batch_size acquisitions or
+/// batch_bytes bytes of data, whichever is reached first, and each batch is written with a
+/// single HDF5 call. A batch size of 1 uses ISMRMRD::Dataset::appendAcquisition directly.
+///
+/// With a queue depth > 0 the appends run on a dedicated writer thread, which drains a
+/// bounded lock-free single producer/single consumer queue. The parser therefore only
+/// stalls when HDF5 falls behind by more than queue_depth items.
+/// With a queue depth of 0 everything is written synchronously on the calling thread.
+///
+/// Written acquisitions are handed back to the pool, if there is one, instead of being deleted.
+///
+/// The dataset must not be used by anyone else until close() has returned.
+class DatasetWriter
+{
+public:
+    DatasetWriter(boost::shared_ptr<BatchedDataset> dataset, size_t queue_depth, size_t batch_size = 1,
+                  size_t batch_bytes = 0, boost::shared_ptr<AcquisitionPool> pool = boost::shared_ptr<AcquisitionPool>());
+    ~DatasetWriter();
+
+    void appendAcquisition(std::unique_ptr<ISMRMRD::Acquisition> acq);
+    void appendWaveform(std::unique_ptr<ISMRMRD::Waveform> wav);
+
+    /// Waits until all queued items are written and stops the writer thread.
+    /// Throws if the writer thread failed to write an item.
+    void close();
+
+    /// Prints how much time the writer spent writing and waiting
+    void printStatistics(std::ostream &os) const;
+
+private:
+    DatasetWriter(const DatasetWriter &);
+    DatasetWriter &operator=(const DatasetWriter &);
+
+    struct QueueItem
+    {
+        ISMRMRD::Acquisition *acq;
+        ISMRMRD::Waveform *wav;
+    };
+
+    void push(const QueueItem &item);
+    void write(const QueueItem &item);
+    void flush();
+    void run();
+    void release(std::unique_ptr<ISMRMRD::Acquisition> acq);
+
+    boost::shared_ptr<BatchedDataset> dataset_;
+    boost::shared_ptr<AcquisitionPool> pool_;
+    boost::scoped_ptr<boost::lockfree::spsc_queue<QueueItem> > queue_;
+    std::thread thread_;
+
+    size_t batch_size_;
+    size_t batch_bytes_;
+    std::vector<ISMRMRD::Acquisition *> batch_;
+    size_t pending_bytes_;
+
+    std::atomic<bool> done_;
+    std::atomic<bool> failed_;
+    std::string error_;
+    bool closed_;
+
+    unsigned long acquisitions_;
+    unsigned long waveforms_;
+    unsigned long batches_;
+    double busy_seconds_;
+    double stalled_seconds_;
+    double producer_stalled_seconds_;
+};
+
+#endif //DATASETWRITER_H_
@@ -0,0 +1,24 @@
+#ifndef EMBEDDEDFILES_H_
+#define EMBEDDEDFILES_H_
+
+#include <stddef.h>
+#include <string>
+
+/// A parameter map, stylesheet or schema compiled into the converter by the embed tool.
+/// The table and the contents are constant data of the generated defaults.cpp, nothing is
+/// decoded or copied when the program starts.
+struct EmbeddedFile
+{
+    const char *name;   // File name without the directory
+    const char *data;   // Contents, followed by a terminating 0 that is not part of size
+    size_t size;
+};
+
+// Defined in the generated defaults.cpp, sorted by name
+extern const EmbeddedFile embedded_files[];
+extern const size_t embedded_file_count;
+
+/// The embedded file with this name, or NULL
+const EmbeddedFile *findEmbeddedFile(const std::string &name);
+
+#endif //EMBEDDEDFILES_H_
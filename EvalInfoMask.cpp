@@ -0,0 +1,110 @@
+#include "EvalInfoMask.h"
+
+#include "ismrmrd/ismrmrd.h"
+
+#include <sstream>
+#include <stdexcept>
+
+EvalInfoFlagTable::EvalInfoFlagTable(const std::vector<EvalInfoRule> &rules)
+{
+    for (int byte = 0; byte < 8; byte++) {
+        for (int value = 0; value < 256; value++) {
+            table_[byte][value] = 0;
+        }
+    }
+
+    for (size_t r = 0; r < rules.size(); r++) {
+        const EvalInfoRule &rule = rules[r];
+        if (rule.mask_bit < 0 || rule.mask_bit > 63 || rule.unless_bit > 63 || rule.ismrmrd_flag < 1 ||
+            rule.ismrmrd_flag > 64) {
+            std::stringstream msg;
+            msg << "Invalid eval info mask rule for bit " << rule.mask_bit;
+            throw std::runtime_error(msg.str());
+        }
+        if (rule.unless_bit >= 0 && rule.unless_bit / 8 != rule.mask_bit / 8) {
+            std::stringstream msg;
+            msg << "Eval info mask bits " << rule.mask_bit << " and " << rule.unless_bit
+                << " are not in the same byte of the mask";
+            throw std::runtime_error(msg.str());
+        }
+
+        int byte = rule.mask_bit / 8;
+        int bit = 1 << (rule.mask_bit % 8);
+        int unless = rule.unless_bit >= 0 ? 1 << (rule.unless_bit % 8) : 0;
+        for (int value = 0; value < 256; value++) {
+            if ((value & bit) && !(value & unless)) {
+                table_[byte][value] |= 1ULL << (rule.ismrmrd_flag - 1);
+            }
+        }
+    }
+}
+
+// Software lines a rule applies to, as bits 1 << EvalInfoVariant
+static const unsigned int EVAL_INFO_ALL = (1 << EVAL_INFO_VB) | (1 << EVAL_INFO_VD) | (1 << EVAL_INFO_NX);
+
+struct VariantRule
+{
+    unsigned int variants;
+    EvalInfoRule rule;
+};
+
+// VB, VD and NX set the same bits for everything converted so far. A bit that only some software
+// lines use gets a row with just those variants.
+static const VariantRule eval_info_rules[] = {
+    {EVAL_INFO_ALL, {25, -1, ISMRMRD::ISMRMRD_ACQ_IS_NOISE_MEASUREMENT}},
+    {EVAL_INFO_ALL, {28, -1, ISMRMRD::ISMRMRD_ACQ_FIRST_IN_SLICE}},
+    {EVAL_INFO_ALL, {29, -1, ISMRMRD::ISMRMRD_ACQ_LAST_IN_SLICE}},
+    {EVAL_INFO_ALL, {11, -1, ISMRMRD::ISMRMRD_ACQ_LAST_IN_REPETITION}},
+    {EVAL_INFO_ALL, {11, -1, ISMRMRD::ISMRMRD_ACQ_LAST_IN_MEASUREMENT}},
+    {EVAL_INFO_ALL, {46, -1, ISMRMRD::ISMRMRD_ACQ_LAST_IN_MEASUREMENT}},
+    // A line that is both image and ref does not get the ref flag
+    {EVAL_INFO_ALL, {23, -1, ISMRMRD::ISMRMRD_ACQ_IS_PARALLEL_CALIBRATION_AND_IMAGING}},
+    {EVAL_INFO_ALL, {22, 23, ISMRMRD::ISMRMRD_ACQ_IS_PARALLEL_CALIBRATION}},
+    {EVAL_INFO_ALL, {24, -1, ISMRMRD::ISMRMRD_ACQ_IS_REVERSE}},
+    {EVAL_INFO_ALL, {21, -1, ISMRMRD::ISMRMRD_ACQ_IS_PHASECORR_DATA}},
+    {EVAL_INFO_ALL, {1, -1, ISMRMRD::ISMRMRD_ACQ_IS_NAVIGATION_DATA}},
+    {EVAL_INFO_ALL, {1, -1, ISMRMRD::ISMRMRD_ACQ_IS_RTFEEDBACK_DATA}},
+    {EVAL_INFO_ALL, {2, -1, ISMRMRD::ISMRMRD_ACQ_IS_HPFEEDBACK_DATA}},
+    {EVAL_INFO_ALL, {51, -1, ISMRMRD::ISMRMRD_ACQ_IS_DUMMYSCAN_DATA}},
+    {EVAL_INFO_ALL, {5, -1, ISMRMRD::ISMRMRD_ACQ_IS_DUMMYSCAN_DATA}}, // syncdata
+    {EVAL_INFO_ALL, {10, -1, ISMRMRD::ISMRMRD_ACQ_IS_SURFACECOILCORRECTIONSCAN_DATA}},
+    {EVAL_INFO_ALL, {14, -1, ISMRMRD::ISMRMRD_ACQ_IS_PHASE_STABILIZATION_REFERENCE}},
+    {EVAL_INFO_ALL, {15, -1, ISMRMRD::ISMRMRD_ACQ_IS_PHASE_STABILIZATION}},
+};
+
+std::vector<EvalInfoRule> evalInfoRules(EvalInfoVariant variant)
+{
+    std::vector<EvalInfoRule> rules;
+    for (size_t r = 0; r < sizeof(eval_info_rules) / sizeof(eval_info_rules[0]); r++) {
+        if (eval_info_rules[r].variants & (1 << variant)) {
+            rules.push_back(eval_info_rules[r].rule);
+        }
+    }
+    return rules;
+}
+
+const EvalInfoFlagTable &evalInfoFlagTable(EvalInfoVariant variant)
+{
+    switch (variant) {
+        case EVAL_INFO_VB: {
+            static const EvalInfoFlagTable vb(evalInfoRules(EVAL_INFO_VB));
+            return vb;
+        }
+        case EVAL_INFO_NX: {
+            static const EvalInfoFlagTable nx(evalInfoRules(EVAL_INFO_NX));
+            return nx;
+        }
+        default: {
+            static const EvalInfoFlagTable vd(evalInfoRules(EVAL_INFO_VD));
+            return vd;
+        }
+    }
+}
+
+EvalInfoVariant evalInfoVariant(bool isVB, bool isNX)
+{
+    if (isVB) {
+        return EVAL_INFO_VB;
+    }
+    return isNX ? EVAL_INFO_NX : EVAL_INFO_VD;
+}
@@ -0,0 +1,60 @@
+#ifndef EVALINFOMASK_H_
+#define EVALINFOMASK_H_
+
+#include <stdint.h>
+#include <vector>
+
+/// Software lines that write .dat files, selects the eval info mask mapping
+enum EvalInfoVariant
+{
+    EVAL_INFO_VB,
+    EVAL_INFO_VD,
+    EVAL_INFO_NX
+};
+
+/// One bit of the Siemens eval info mask and the ISMRMRD acquisition flag it sets.
+/// unless_bit is another mask bit (or -1) that suppresses the flag when it is set as well,
+/// e.g. a line that is both PAT reference and imaging data is not flagged as PAT reference only.
+struct EvalInfoRule
+{
+    int mask_bit;
+    int unless_bit;
+    uint64_t ismrmrd_flag; // ISMRMRD::ISMRMRD_ACQ_* value as passed to setFlag
+};
+
+/// Translation of the two 32 bit aulEvalInfoMask words to the 64 bit ISMRMRD acquisition flags.
+///
+/// The rules are compiled into one table per byte of the mask, the flags of a scan are the
+/// OR of eight lookups. A rule and its unless_bit have to be in the same byte of the mask,
+/// the constructor throws std::runtime_error otherwise.
+class EvalInfoFlagTable
+{
+public:
+    explicit EvalInfoFlagTable(const std::vector<EvalInfoRule> &rules);
+
+    /// ISMRMRD flags as a bit field, flag f is bit f - 1 like in ismrmrd_set_flag
+    uint64_t flags(const uint32_t *eval_info_mask) const
+    {
+        uint64_t mask = eval_info_mask[0] | ((uint64_t) eval_info_mask[1] << 32);
+        uint64_t flags = 0;
+        for (int byte = 0; byte < 8; byte++) {
+            flags |= table_[byte][(mask >> (8 * byte)) & 0xff];
+        }
+        return flags;
+    }
+
+private:
+    uint64_t table_[8][256];
+};
+
+/// Rules of eval_info_rules in EvalInfoMask.cpp that apply to files of the given software line.
+/// A different mapping can be built by passing a changed copy to EvalInfoFlagTable.
+std::vector<EvalInfoRule> evalInfoRules(EvalInfoVariant variant);
+
+/// Mapping used for files written by the given software line, built on first use
+const EvalInfoFlagTable &evalInfoFlagTable(EvalInfoVariant variant);
+
+/// Software line of a measurement, from the baseline and software version checks of MeasurementReader
+EvalInfoVariant evalInfoVariant(bool isVB, bool isNX);
+
+#endif //EVALINFOMASK_H_
@@ -0,0 +1,391 @@
+#include "MeasurementReader.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+MeasurementReader::MeasurementReader(const ConversionSettings &settings, unsigned int measurement)
+    : settings_(settings)
+    , measurement_(measurement)
+    , siemens_dat_(settings.siemens_dat_filename, true, settings.follow_timeout)
+    , measurement_end_(0)
+    , header_complete_(false)
+    , trajectory_()
+    , dwell_time_0_(0)
+    , max_channels_(0)
+    , isAdjustCoilSens_(false)
+    , isAdjQuietCoilSens_(false)
+    , isVB_(false)
+    , isNX_(false)
+    , skip_syncdata_(settings.skip_syncdata)
+    , last_mask_(0)
+    , acquisitions_(1)
+    , sync_data_packets_(0)
+    , first_scan_(true)
+    , end_(false)
+    , finished_(false)
+    , has_pending_scan_(false)
+{
+    global_table_pos_[0] = global_table_pos_[1] = global_table_pos_[2] = 0;
+
+    if (!siemens_dat_.is_open()) {
+        throw std::runtime_error("Provided Siemens file can not be open or does not exist.");
+    }
+
+    if (!settings_.VBFILE && measurement_ > settings_.ParcRaidHead.count_) {
+        std::stringstream message;
+        message << "The file you are trying to convert has only " << settings_.ParcRaidHead.count_
+                << " measurements. You are trying to convert measurement number: " << measurement_;
+        throw std::runtime_error(message.str());
+    }
+
+    //if it is a VB scan
+    if (settings_.VBFILE && measurement_ != 1) {
+        std::stringstream message;
+        message << "The file you are trying to convert is a VB file and it has only one measurement. "
+                << "You tried to convert measurement number: " << measurement_;
+        throw std::runtime_error(message.str());
+    }
+
+    readMeasurementHeader();
+}
+
+void MeasurementReader::readMeasurementHeader() {
+    const bool VBFILE = settings_.VBFILE;
+    const bool debug_xml = settings_.debug_xml;
+    const MrParcRaidFileEntry &entry = settings_.ParcFileEntries[measurement_ - 1];
+
+    // Parameter map
+    std::string default_parammap;
+    if (VBFILE) {
+        default_parammap = "IsmrmrdParameterMap_Siemens_VB17.xml";
+    } else {
+        default_parammap = "IsmrmrdParameterMap_Siemens.xml";
+    }
+    std::string parammap_actual_file = select_file(settings_.parammap_file, default_parammap, settings_.all_measurements, measurement_);
+    std::string parammap_file_content = get_file_content(parammap_actual_file);
+    std::cout << "Using parameter map: " << parammap_actual_file << std::endl;
+    boost::shared_ptr<const ParameterMap> parameter_map = compileParameterMap(parammap_file_content);
+
+    // find the beginning of the desired measurement
+    siemens_dat_.seek(entry.off_);
+
+    uint32_t dma_length = 0, num_buffers = 0;
+
+    siemens_dat_.read(dma_length);
+    siemens_dat_.read(num_buffers);
+
+    auto buffers = readMeasurementHeaderBuffers(siemens_dat_, num_buffers);
+
+    //We need to be on a 32 byte boundary after reading the buffers
+    long long int position_in_meas = (long long int) (siemens_dat_.tell()) - entry.off_;
+    if (position_in_meas % 32 != 0) {
+        siemens_dat_.skip(32 - (position_in_meas % 32));
+    }
+
+    // Measurement header done!
+    //Now we should have the measurement headers, so let's use the Meas header to create the XML parameters
+    //The other buffers are only read for --bufferAppend
+    loadMeasurementHeaderBuffers(siemens_dat_, buffers, "Meas");
+    std::vector<std::string> wip_double;
+    long radial_views;
+    std::string baseLineString;
+    std::string protocol_name;
+    std::string software_version;
+    std::string xml_config = readXmlConfig(debug_xml, *parameter_map, num_buffers, buffers, wip_double,
+        trajectory_, dwell_time_0_,
+        max_channels_, radial_views, global_table_pos_, baseLineString, protocol_name, software_version);
+
+    // whether this scan is a adjustment scan
+    isAdjustCoilSens_ = (protocol_name == "AdjCoilSens");
+    isAdjQuietCoilSens_ = (protocol_name == "AdjQuietCoilSens");
+
+    // whether this scan is from VB line
+    if ((baseLineString.find("VB17") != std::string::npos)
+        || (baseLineString.find("VB15") != std::string::npos)
+        || (baseLineString.find("VB13") != std::string::npos)
+        || (baseLineString.find("VB11") != std::string::npos)) {
+        isVB_ = true;
+    }
+
+    std::cout << "Baseline: " << baseLineString << std::endl;
+    std::cout << "Software version: " << software_version << std::endl;
+    std::cout << "Protocol name: " << protocol_name << std::endl;
+
+    if ((baseLineString.find("NXVA") != std::string::npos) || (software_version.find("syngo MR XA") != std::string::npos) )
+    {
+        isNX_ = true;
+    }
+
+    if (isNX_)
+    {
+        int nxVersion = atoi(software_version.substr(11).c_str());
+        std::cout << "Detected Numaris/X version: " << nxVersion << std::endl;
+        if (nxVersion > 30)
+        {
+            // NX versions with incompatible syncdata disable it for this measurement only
+            skip_syncdata_ = true;
+            std::cout << "Disabling parsing of syncdata due to incompatibility!" << std::endl;
+        }
+    }
+
+    std::cout << "Dwell time: " << dwell_time_0_ << std::endl;
+
+    //If this is a spiral acquisition, we will calculate the trajectory and add it to the individual profiles
+    if (settings_.attachTrajectory && trajectory_ == Trajectory::TRAJECTORY_SPIRAL) {
+        traj_ = cachedSpiralTrajectory(spiralParameters(wip_double, dwell_time_0_, radial_views),
+                                       settings_.trajectory_cache_dir);
+    }
+
+    if (debug_xml) {
+        std::ofstream o("xml_raw.xml");
+        o.write(xml_config.c_str(), xml_config.size());
+    }
+
+    // Parameter style-sheet
+    std::string default_parammap_xsl;
+    if (isNX_) {
+        default_parammap_xsl = "IsmrmrdParameterMap_Siemens_NX.xsl";
+    } else {
+        default_parammap_xsl = "IsmrmrdParameterMap_Siemens.xsl";
+    }
+    std::string parammap_xsl_actual_file = select_file(settings_.parammap_xsl, default_parammap_xsl, settings_.all_measurements, measurement_);
+    std::string parammap_xsl_content = get_file_content(parammap_xsl_actual_file);
+    std::cout << "Using parameter XSL: " << parammap_xsl_actual_file << std::endl;
+
+    {
+        std::lock_guard<std::mutex> lock(xml_mutex);
+        std::string config = parseXML(debug_xml, parammap_xsl_content, xml_config);
+        ISMRMRD::deserialize(config.c_str(), header_);
+    }
+    //Append buffers to xml_config if requested
+    if (settings_.append_buffers) {
+        loadMeasurementHeaderBuffers(siemens_dat_, buffers);
+        append_buffers_to_xml_header(buffers, num_buffers, header_);
+    }
+
+    measurement_end_ = entry.off_ + entry.len_;
+}
+
+// Reads scan headers up to the next one that is not syncdata, the waveforms of the syncdata on the way are queued.
+// Returns false at the end of the measurement.
+bool MeasurementReader::nextScan(sScanHeader &scanhead) {
+    // A file that is still being written is read up to the ACQEND scan, its measurement length can not be trusted
+    const bool follow = settings_.follow_timeout > 0;
+
+    while (!end_ &&
+        !(last_mask_ & 1) && //Last scan not encountered
+        (follow || siemens_dat_.tell() + sizeof(sScanHeader) < measurement_end_))  //not reached end of measurement without acqend
+    {
+        readScanHeader(siemens_dat_, settings_.VBFILE, mdh_, scanhead);
+
+        if (!siemens_dat_) {
+            std::cerr << "Error reading header at acquisition " << acquisitions_ << "." << std::endl;
+            break;
+        }
+
+        uint32_t dma_length = scanhead.ulFlagsAndDMALength & MDH_DMA_LENGTH_MASK;
+
+        //Check if this is synch data, if so, it must be handled differently.
+        if (scanhead.aulEvalInfoMask[0] & (1 << 5)) {
+            uint32_t last_scan_counter = acquisitions_ - 1;
+
+            auto waveforms = readSyncdata(siemens_dat_, settings_.VBFILE, acquisitions_, dma_length, scanhead, header_,
+                                          last_scan_counter, skip_syncdata_);
+            for (auto &w : waveforms)
+                pending_waveforms_.push_back(std::move(w));
+            sync_data_packets_++;
+            continue;
+        }
+
+        return true;
+    }
+
+    end_ = true;
+    return false;
+}
+
+// Fills what the protocol does not provide, like the study time, and validates the result
+void MeasurementReader::completeHeader(uint32_t time_stamp) {
+    // convert to acqusition date and time
+    double timeInSeconds = time_stamp * 2.5 / 1e3;
+
+    size_t hours = (size_t) (timeInSeconds / 3600);
+    size_t mins = (size_t) ((timeInSeconds - hours * 3600) / 60);
+    size_t secs = (size_t) (timeInSeconds - hours * 3600 - mins * 60);
+
+    hours = hours % 24;
+    mins  = mins  % 60;
+
+    std::string study_time = get_time_string(hours, mins, secs);
+
+    // if some of the ismrmrd header fields are not filled, here is a place to take some further actions
+    if (!fill_ismrmrd_header(header_, settings_.study_date_user_supplied, study_time)) {
+        std::cerr << "Failed to further fill XML header" << std::endl;
+    }
+
+    if (settings_.skip_validation) {
+        ISMRMRD::UserParameterString p;
+        p.name = "SchemaValidation";
+        p.value = "skipped";
+        if (!header_.userParameters.is_present()) {
+            ISMRMRD::UserParameters up;
+            header_.userParameters = up;
+        }
+        header_.userParameters().userParameterString.push_back(p);
+    }
+
+    std::stringstream sstream;
+    ISMRMRD::serialize(header_, sstream);
+    xml_header_ = sstream.str();
+    header_complete_ = true;
+
+    // This is the only validation of the header, the output of the parameter stylesheet is not validated
+    if (!settings_.skip_validation) {
+        int xml_valid;
+        {
+            std::lock_guard<std::mutex> lock(xml_mutex);
+            xml_valid = xml_file_is_valid(xml_header_, settings_.schema_file_name_content);
+        }
+        if (xml_valid <= 0) {
+            throw std::runtime_error("Generated XML is not valid according to the ISMRMRD schema");
+        }
+    }
+
+    if (settings_.debug_xml) {
+        std::ofstream o("processed.xml");
+        o.write(xml_header_.c_str(), xml_header_.size());
+    }
+}
+
+const ISMRMRD::IsmrmrdHeader &MeasurementReader::header() {
+    if (!header_complete_) {
+        has_pending_scan_ = nextScan(pending_scan_);
+        completeHeader(has_pending_scan_ ? pending_scan_.ulTimeStamp : 0);
+    }
+    return header_;
+}
+
+const std::string &MeasurementReader::xmlHeader() {
+    header();
+    return xml_header_;
+}
+
+bool MeasurementReader::next(MeasurementItem &item) {
+    header();
+
+    for (;;) {
+        if (!pending_waveforms_.empty()) {
+            item.type = MeasurementItem::WAVEFORM;
+            item.acquisition.reset();
+            item.waveform.reset(new ISMRMRD::Waveform(std::move(pending_waveforms_.front())));
+            pending_waveforms_.pop_front();
+            return true;
+        }
+
+        sScanHeader scanhead;
+        if (has_pending_scan_) {
+            scanhead = pending_scan_;
+            has_pending_scan_ = false;
+        } else if (!nextScan(scanhead)) {
+            if (!pending_waveforms_.empty()) {
+                continue;
+            }
+            finish();
+            return false;
+        }
+
+        //This check only makes sense in VD line files.
+        const MrParcRaidFileEntry &entry = settings_.ParcFileEntries[measurement_ - 1];
+        if (!settings_.VBFILE && (scanhead.lMeasUID != entry.measId_)) {
+            //Something must have gone terribly wrong. Bail out.
+            if (first_scan_) {
+                std::cerr << "Corrupted or retro-recon dataset detected (scanhead.lMeasUID != ParcFileEntries["
+                        << measurement_ - 1 << "].measId_)" << std::endl;
+                std::cerr << "Fix the scanhead.lMeasUID ... " << std::endl;
+            }
+            scanhead.lMeasUID = entry.measId_;
+        }
+        first_scan_ = false;
+
+        last_mask_ = scanhead.aulEvalInfoMask[0];
+
+        if (scanhead.aulEvalInfoMask[0] & 1) {
+            //No acquisition is created for the last scan, just move past its channel data
+            readChannelData(siemens_dat_, settings_.VBFILE, scanhead, NULL);
+            acquisitions_++;
+            std::cout << "Last scan reached..." << std::endl;
+            end_ = true;
+            continue;
+        }
+
+        //The channel data is read straight into the acquisition
+        std::unique_ptr<ISMRMRD::Acquisition> acq;
+        if (pool_) {
+            acq = pool_->take();
+        } else {
+            acq.reset(new ISMRMRD::Acquisition());
+        }
+        getAcquisition(settings_.flash_pat_ref_scan, trajectory_, dwell_time_0_, global_table_pos_, max_channels_,
+                       isAdjustCoilSens_, isAdjQuietCoilSens_, isVB_, isNX_, traj_.get(),
+                       scanhead, siemens_dat_, settings_.VBFILE, *acq);
+
+        if (!siemens_dat_) {
+            std::cerr << "Error reading data at acquisition " << acquisitions_ << "." << std::endl;
+            end_ = true;
+            continue;
+        }
+
+        acquisitions_++;
+        item.type = MeasurementItem::ACQUISITION;
+        item.acquisition = std::move(acq);
+        item.waveform.reset();
+        return true;
+    }
+}
+
+// Checks that the measurement ended where the file says it does
+void MeasurementReader::finish() {
+    if (finished_ || !siemens_dat_) {
+        return;
+    }
+    finished_ = true;
+
+    if (settings_.follow_timeout > 0) {
+        // The file may still be growing, the end of the measurement is wherever ACQEND was found
+        return;
+    }
+
+    const MrParcRaidFileEntry &entry = settings_.ParcFileEntries[measurement_ - 1];
+
+    //Mystery bytes. There seems to be 160 mystery bytes at the end of the data.
+    int64_t mystery_bytes = (int64_t) measurement_end_ - (int64_t) siemens_dat_.tell();
+
+    if (mystery_bytes > 0) {
+        if (mystery_bytes != MYSTERY_BYTES_EXPECTED) {
+            // Something in not quite right
+            std::cerr << "WARNING: Unexpected number of mystery bytes detected: " << mystery_bytes << std::endl;
+            std::cerr << "ParcFileEntries[" << measurement_ - 1 << "].off_ = " << entry.off_ << std::endl;
+            std::cerr << "ParcFileEntries[" << measurement_ - 1 << "].len_ = " << entry.len_ << std::endl;
+            std::cerr << "siemens_dat.tell() = " << siemens_dat_.tell() << std::endl;
+            std::cerr << "Please check the result." << std::endl;
+        } else {
+            // Skip the mystery bytes
+            siemens_dat_.skip(mystery_bytes);
+            //After this we have to be on a 512 byte boundary
+            if (siemens_dat_.tell() % 512) {
+                siemens_dat_.skip(512 - (siemens_dat_.tell() % 512));
+            }
+        }
+    }
+
+    uint64_t end_position = siemens_dat_.tell();
+    uint64_t eof_position = siemens_dat_.size();
+    if (end_position != eof_position && settings_.ParcRaidHead.count_ == measurement_) {
+        uint64_t additional_bytes = eof_position - end_position;
+        std::cerr << "WARNING: End of file was not reached during conversion. There are " <<
+                additional_bytes << " additional bytes at the end of file." << std::endl;
+    }
+}
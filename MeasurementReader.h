@@ -0,0 +1,98 @@
+#ifndef MEASUREMENTREADER_H_
+#define MEASUREMENTREADER_H_
+
+#include "Converter.h"
+#include "AcquisitionPool.h"
+
+#include <deque>
+#include <memory>
+
+/// One acquisition or waveform of a measurement, as returned by MeasurementReader::next()
+struct MeasurementItem
+{
+    enum Type { ACQUISITION, WAVEFORM };
+
+    Type type;
+    std::unique_ptr<ISMRMRD::Acquisition> acquisition; // Set for ACQUISITION
+    std::unique_ptr<ISMRMRD::Waveform> waveform;       // Set for WAVEFORM
+};
+
+/// Pull style conversion of one measurement of a .dat file.
+///
+/// The constructor reads the measurement header buffers and creates the ISMRMRD header with the
+/// parameter map and stylesheet. The study time of the header comes from the time stamp of the first
+/// scan, so header() reads ahead up to that scan; the syncdata found on the way is kept and returned
+/// first by next(). next() then returns the acquisitions and waveforms in file order until the ACQEND
+/// scan or the end of the measurement.
+/// With settings.follow_timeout > 0 the file may still be growing; reads wait for the data and
+/// the measurement only ends with the ACQEND scan (or when no data arrives within the timeout).
+///
+/// Errors while setting up the conversion (missing files, unknown measurement, invalid header) throw
+/// std::runtime_error. Read errors end the measurement early and leave good() false.
+///
+/// Several readers may be used concurrently, libxml2/libxslt calls are serialized through xml_mutex.
+class MeasurementReader
+{
+public:
+    /// settings must have been filled by readFileLayout(), measurement is 1 based
+    MeasurementReader(const ConversionSettings &settings, unsigned int measurement);
+
+    const ISMRMRD::IsmrmrdHeader &header();
+
+    /// Serialized header(), validated against the ISMRMRD schema unless settings.skip_validation is set
+    const std::string &xmlHeader();
+
+    /// Returns false once the measurement is done
+    bool next(MeasurementItem &item);
+
+    /// Acquisitions returned by next() are taken from the pool, the consumer recycles them when
+    /// it is done with them. Without a pool every acquisition is allocated anew.
+    void setAcquisitionPool(boost::shared_ptr<AcquisitionPool> pool) { pool_ = pool; }
+
+    bool good() const { return siemens_dat_.good(); }
+
+private:
+    MeasurementReader(const MeasurementReader &);
+    MeasurementReader &operator=(const MeasurementReader &);
+
+    void readMeasurementHeader();
+    bool nextScan(sScanHeader &scanhead);
+    void completeHeader(uint32_t time_stamp);
+    void finish();
+
+    ConversionSettings settings_;
+    unsigned int measurement_;
+    DatReader siemens_dat_;
+    uint64_t measurement_end_;
+
+    ISMRMRD::IsmrmrdHeader header_;
+    std::string xml_header_;
+    bool header_complete_;
+
+    // Protocol information from the measurement header
+    Trajectory trajectory_;
+    long dwell_time_0_;
+    long max_channels_;
+    long global_table_pos_[3];
+    bool isAdjustCoilSens_;
+    bool isAdjQuietCoilSens_;
+    bool isVB_;
+    bool isNX_;
+    bool skip_syncdata_;
+    boost::shared_ptr<const SpiralTrajectory> traj_; // Only with settings.attachTrajectory for spirals
+
+    // Scan loop state
+    sMDH mdh_; //For VB line
+    uint32_t last_mask_;
+    unsigned long acquisitions_;
+    unsigned long sync_data_packets_;
+    bool first_scan_;
+    bool end_;
+    bool finished_;
+    bool has_pending_scan_;
+    sScanHeader pending_scan_;
+    std::deque<ISMRMRD::Waveform> pending_waveforms_;
+    boost::shared_ptr<AcquisitionPool> pool_;
+};
+
+#endif //MEASUREMENTREADER_H_
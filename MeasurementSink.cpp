@@ -0,0 +1,174 @@
+#include "MeasurementSink.h"
+
+#include "ismrmrd/serialization.h"
+#include "ismrmrd/serialization_iostream.h"
+
+#include <boost/asio.hpp>
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+typedef std::chrono::steady_clock Clock;
+
+static double seconds_since(const Clock::time_point &start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+DatasetSink::DatasetSink(boost::shared_ptr<BatchedDataset> dataset, size_t queue_depth, size_t batch_size,
+                         size_t batch_bytes, boost::shared_ptr<AcquisitionPool> pool)
+    : dataset_(dataset)
+    , writer_(dataset, queue_depth, batch_size, batch_bytes, pool)
+{
+}
+
+void DatasetSink::writeHeader(const ISMRMRD::IsmrmrdHeader &header)
+{
+    // Written by close(), HDF5 does not care about the order
+    std::stringstream sstream;
+    ISMRMRD::serialize(header, sstream);
+    xml_header_ = sstream.str();
+}
+
+void DatasetSink::appendAcquisition(std::unique_ptr<ISMRMRD::Acquisition> acq)
+{
+    writer_.appendAcquisition(std::move(acq));
+}
+
+void DatasetSink::appendWaveform(std::unique_ptr<ISMRMRD::Waveform> wav)
+{
+    writer_.appendWaveform(std::move(wav));
+}
+
+void DatasetSink::close()
+{
+    writer_.close();
+
+    if (!xml_header_.empty()) {
+        std::lock_guard<std::mutex> lock(hdf5_mutex());
+        dataset_->writeHeader(xml_header_);
+    }
+}
+
+void DatasetSink::printStatistics(std::ostream &os) const
+{
+    writer_.printStatistics(os);
+}
+
+StreamSink::StreamSink(std::ostream &os, boost::shared_ptr<AcquisitionPool> pool)
+    : os_(os)
+    , view_(new ISMRMRD::OStreamView(os))
+    , pool_(pool)
+    , acquisitions_(0)
+    , waveforms_(0)
+    , busy_seconds_(0)
+{
+    serializer_.reset(new ISMRMRD::ProtocolSerializer(*view_));
+}
+
+StreamSink::~StreamSink()
+{
+}
+
+void StreamSink::check()
+{
+    if (!os_) {
+        throw std::runtime_error("Failed to write to the output stream");
+    }
+}
+
+void StreamSink::writeHeader(const ISMRMRD::IsmrmrdHeader &header)
+{
+    serializer_->serialize(header);
+    os_.flush();
+    check();
+}
+
+void StreamSink::appendAcquisition(std::unique_ptr<ISMRMRD::Acquisition> acq)
+{
+    Clock::time_point start = Clock::now();
+    serializer_->serialize(*acq);
+    busy_seconds_ += seconds_since(start);
+    acquisitions_++;
+    check();
+    if (pool_) {
+        pool_->recycle(std::move(acq));
+    }
+}
+
+void StreamSink::appendWaveform(std::unique_ptr<ISMRMRD::Waveform> wav)
+{
+    Clock::time_point start = Clock::now();
+    serializer_->serialize(*wav);
+    busy_seconds_ += seconds_since(start);
+    waveforms_++;
+    check();
+}
+
+void StreamSink::close()
+{
+    serializer_->close();
+    os_.flush();
+    check();
+}
+
+void StreamSink::printStatistics(std::ostream &os) const
+{
+    os << "Stream writer: " << acquisitions_ << " acquisitions, " << waveforms_ << " waveforms, busy "
+       << busy_seconds_ << " s" << std::endl;
+}
+
+std::unique_ptr<std::ostream> openStreamTarget(const std::string &target)
+{
+    if (target == "-") {
+#ifdef _WIN32
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+        std::unique_ptr<std::ostream> os(new std::ostream(std::cout.rdbuf()));
+        // Keep the log out of the stream
+        std::cout.rdbuf(std::cerr.rdbuf());
+        return os;
+    }
+
+    if (target.compare(0, 4, "tcp:") == 0) {
+        std::string address = target.substr(4);
+        size_t colon = address.rfind(':');
+        if (colon == std::string::npos) {
+            throw std::runtime_error("Stream target " + target + " has no port, use tcp:host:port");
+        }
+        std::unique_ptr<boost::asio::ip::tcp::iostream> os(
+            new boost::asio::ip::tcp::iostream(address.substr(0, colon), address.substr(colon + 1)));
+        if (!*os) {
+            throw std::runtime_error("Failed to connect to " + target + ": " + os->error().message());
+        }
+        return std::unique_ptr<std::ostream>(os.release());
+    }
+
+    if (target.compare(0, 5, "unix:") == 0) {
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+        std::unique_ptr<boost::asio::local::stream_protocol::iostream> os(
+            new boost::asio::local::stream_protocol::iostream());
+        os->connect(boost::asio::local::stream_protocol::endpoint(target.substr(5)));
+        if (!*os) {
+            throw std::runtime_error("Failed to connect to " + target + ": " + os->error().message());
+        }
+        return std::unique_ptr<std::ostream>(os.release());
+#else
+        throw std::runtime_error("Unix domain sockets are not supported on this platform");
+#endif
+    }
+
+    std::unique_ptr<std::ofstream> os(new std::ofstream(target.c_str(), std::ios::out | std::ios::binary));
+    if (!*os) {
+        throw std::runtime_error("Failed to open stream target " + target);
+    }
+    return std::unique_ptr<std::ostream>(os.release());
+}
@@ -0,0 +1,98 @@
+#ifndef MEASUREMENTSINK_H_
+#define MEASUREMENTSINK_H_
+
+#include "ismrmrd/ismrmrd.h"
+#include "ismrmrd/xml.h"
+#include "BatchedDataset.h"
+#include "DatasetWriter.h"
+#include "AcquisitionPool.h"
+
+#include <boost/shared_ptr.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include <memory>
+#include <ostream>
+#include <string>
+
+namespace ISMRMRD {
+class OStreamView;
+class ProtocolSerializer;
+}
+
+/// Destination of a converted measurement. The header is written first, then the acquisitions and
+/// waveforms in the order MeasurementReader returns them, then close() is called.
+class MeasurementSink
+{
+public:
+    virtual ~MeasurementSink() {}
+
+    virtual void writeHeader(const ISMRMRD::IsmrmrdHeader &header) = 0;
+    virtual void appendAcquisition(std::unique_ptr<ISMRMRD::Acquisition> acq) = 0;
+    virtual void appendWaveform(std::unique_ptr<ISMRMRD::Waveform> wav) = 0;
+
+    /// Writes whatever is still pending. Throws if something could not be written.
+    virtual void close() = 0;
+
+    virtual void printStatistics(std::ostream &os) const = 0;
+};
+
+/// Writes to a group of an ISMRMRD HDF5 file, through a DatasetWriter
+class DatasetSink : public MeasurementSink
+{
+public:
+    DatasetSink(boost::shared_ptr<BatchedDataset> dataset, size_t queue_depth, size_t batch_size, size_t batch_bytes,
+                boost::shared_ptr<AcquisitionPool> pool = boost::shared_ptr<AcquisitionPool>());
+
+    void writeHeader(const ISMRMRD::IsmrmrdHeader &header);
+    void appendAcquisition(std::unique_ptr<ISMRMRD::Acquisition> acq);
+    void appendWaveform(std::unique_ptr<ISMRMRD::Waveform> wav);
+    void close();
+    void printStatistics(std::ostream &os) const;
+
+private:
+    boost::shared_ptr<BatchedDataset> dataset_;
+    DatasetWriter writer_;
+    std::string xml_header_;
+};
+
+/// Writes the ISMRMRD streaming protocol (the messages a reconstruction reads from a socket) to a stream.
+/// Every item is serialized as soon as it is appended; the header is flushed right away so that the
+/// reader can set up while the measurement is still being converted.
+/// Serialized acquisitions go back to the pool, if there is one.
+class StreamSink : public MeasurementSink
+{
+public:
+    explicit StreamSink(std::ostream &os, boost::shared_ptr<AcquisitionPool> pool = boost::shared_ptr<AcquisitionPool>());
+    ~StreamSink();
+
+    void writeHeader(const ISMRMRD::IsmrmrdHeader &header);
+    void appendAcquisition(std::unique_ptr<ISMRMRD::Acquisition> acq);
+    void appendWaveform(std::unique_ptr<ISMRMRD::Waveform> wav);
+
+    /// Sends the close message and flushes the stream
+    void close();
+    void printStatistics(std::ostream &os) const;
+
+private:
+    StreamSink(const StreamSink &);
+    StreamSink &operator=(const StreamSink &);
+
+    void check();
+
+    std::ostream &os_;
+    boost::scoped_ptr<ISMRMRD::OStreamView> view_;
+    boost::scoped_ptr<ISMRMRD::ProtocolSerializer> serializer_;
+    boost::shared_ptr<AcquisitionPool> pool_;
+
+    unsigned long acquisitions_;
+    unsigned long waveforms_;
+    double busy_seconds_;
+};
+
+/// Opens the target of --stream: "-" is stdout, "tcp:host:port" and "unix:path" connect to a listening
+/// socket, anything else is opened as a file, e.g. a named pipe created with mkfifo.
+/// Streaming to stdout moves std::cout, and with it the log of the conversion, to stderr.
+/// Throws std::runtime_error if the target can not be opened.
+std::unique_ptr<std::ostream> openStreamTarget(const std::string &target);
+
+#endif //MEASUREMENTSINK_H_
@@ -0,0 +1,261 @@
+#include "TrajectoryCache.h"
+#include "vds.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/make_shared.hpp>
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+
+static const char TRAJECTORY_FILE_MAGIC[8] = {'S', '2', 'I', 'T', 'R', 'A', 'J', '2'};
+
+SpiralParameters::SpiralParameters()
+    : smax(0)
+    , gmax(0)
+    , fov(0)
+    , krmax(0)
+    , dwell_time(0)
+    , interleaves(0)
+{
+}
+
+bool SpiralParameters::operator<(const SpiralParameters &other) const
+{
+    if (smax != other.smax) return smax < other.smax;
+    if (gmax != other.gmax) return gmax < other.gmax;
+    if (fov != other.fov) return fov < other.fov;
+    if (krmax != other.krmax) return krmax < other.krmax;
+    if (dwell_time != other.dwell_time) return dwell_time < other.dwell_time;
+    return interleaves < other.interleaves;
+}
+
+static bool operator==(const SpiralParameters &a, const SpiralParameters &b)
+{
+    return !(a < b) && !(b < a);
+}
+
+SpiralParameters spiralParameters(const std::vector<std::string> &wip_double, long dwell_time_0, long radial_views)
+{
+    if (wip_double.size() < 10) {
+        std::stringstream sstream;
+        sstream << "Spiral trajectory needs 10 WIP double parameters, the protocol has " << wip_double.size();
+        throw std::runtime_error(sstream.str());
+    }
+    if (radial_views <= 0 || dwell_time_0 <= 0) {
+        throw std::runtime_error("Spiral trajectory needs the number of interleaves and the dwell time");
+    }
+
+    SpiralParameters parameters;
+    parameters.smax = atof(wip_double[7].c_str());
+    parameters.gmax = atof(wip_double[6].c_str());
+    parameters.fov = atof(wip_double[9].c_str());
+    parameters.krmax = atof(wip_double[8].c_str());
+    parameters.dwell_time = dwell_time_0;
+    parameters.interleaves = radial_views;
+    return parameters;
+}
+
+boost::shared_ptr<const SpiralTrajectory> computeSpiralTrajectory(const SpiralParameters &parameters)
+{
+    int nfov = 1;           /*  number of fov coefficients.             */
+    int ngmax = (int) 1e5;  /*  maximum number of gradient samples      */
+
+    double sample_time = (1.0 * parameters.dwell_time) * 1e-9;
+    double fov = parameters.fov;
+    int interleaves = (int) parameters.interleaves;
+
+    /* k-space positions of the first interleave */
+    std::vector<double> kx(ngmax);
+    std::vector<double> ky(ngmax);
+    int ngrad = calc_vds_kspace(parameters.smax, parameters.gmax, sample_time, sample_time, interleaves, &fov, nfov,
+                                parameters.krmax, ngmax, kx.data(), ky.data());
+
+    // 2 * number of points for each X and Y, scaled to -0.5..0.5
+    boost::shared_ptr<SpiralTrajectory> traj = boost::make_shared<SpiralTrajectory>();
+    traj->dimensions = 2;
+    traj->samples = ngrad;
+    traj->interleaves = interleaves;
+    traj->data.resize(traj->dimensions * traj->samples * traj->interleaves);
+    calc_vds_trajectory(kx.data(), ky.data(), ngrad, interleaves, -0.5 / parameters.krmax, traj->data.data());
+
+    return traj;
+}
+
+// File name from the exact parameter values, the parameters are stored in the file as well and checked on load
+static boost::filesystem::path trajectoryCacheFile(const SpiralParameters &parameters, const std::string &cache_dir)
+{
+    std::stringstream key;
+    key << std::setprecision(17) << parameters.smax << '_' << parameters.gmax << '_' << parameters.fov << '_'
+        << parameters.krmax << '_' << parameters.dwell_time << '_' << parameters.interleaves;
+
+    // FNV-1a, stable across compilers and runs
+    uint64_t hash = 14695981039346656037ULL;
+    std::string k = key.str();
+    for (size_t i = 0; i < k.size(); i++) {
+        hash = (hash ^ (unsigned char) k[i]) * 1099511628211ULL;
+    }
+
+    std::stringstream name;
+    name << "spiral_" << std::hex << std::setw(16) << std::setfill('0') << hash << ".traj";
+    return boost::filesystem::path(cache_dir) / name.str();
+}
+
+static void writeParameters(std::ostream &os, const SpiralParameters &parameters)
+{
+    int64_t dwell_time = parameters.dwell_time;
+    int64_t interleaves = parameters.interleaves;
+    os.write((const char *) &parameters.smax, sizeof(double));
+    os.write((const char *) &parameters.gmax, sizeof(double));
+    os.write((const char *) &parameters.fov, sizeof(double));
+    os.write((const char *) &parameters.krmax, sizeof(double));
+    os.write((const char *) &dwell_time, sizeof(int64_t));
+    os.write((const char *) &interleaves, sizeof(int64_t));
+}
+
+static SpiralParameters readParameters(std::istream &is)
+{
+    SpiralParameters parameters;
+    int64_t dwell_time = 0;
+    int64_t interleaves = 0;
+    is.read((char *) &parameters.smax, sizeof(double));
+    is.read((char *) &parameters.gmax, sizeof(double));
+    is.read((char *) &parameters.fov, sizeof(double));
+    is.read((char *) &parameters.krmax, sizeof(double));
+    is.read((char *) &dwell_time, sizeof(int64_t));
+    is.read((char *) &interleaves, sizeof(int64_t));
+    parameters.dwell_time = (long) dwell_time;
+    parameters.interleaves = (long) interleaves;
+    return parameters;
+}
+
+// Returns an empty pointer if there is no usable cache file
+static boost::shared_ptr<const SpiralTrajectory>
+loadTrajectory(const boost::filesystem::path &file, const SpiralParameters &parameters)
+{
+    std::ifstream is(file.string().c_str(), std::ios::in | std::ios::binary);
+    if (!is) {
+        return boost::shared_ptr<const SpiralTrajectory>();
+    }
+
+    char magic[sizeof(TRAJECTORY_FILE_MAGIC)];
+    is.read(magic, sizeof(magic));
+    SpiralParameters stored = readParameters(is);
+    uint64_t dims[3] = {0, 0, 0};
+    is.read((char *) dims, sizeof(dims));
+    if (!is || memcmp(magic, TRAJECTORY_FILE_MAGIC, sizeof(magic)) != 0 || !(stored == parameters) ||
+        dims[0] != 2 || dims[2] != (uint64_t) parameters.interleaves || dims[1] > (1 << 24)) {
+        std::cerr << "WARNING: Ignoring trajectory cache file " << file.string() << std::endl;
+        return boost::shared_ptr<const SpiralTrajectory>();
+    }
+
+    boost::shared_ptr<SpiralTrajectory> traj = boost::make_shared<SpiralTrajectory>();
+    traj->dimensions = dims[0];
+    traj->samples = dims[1];
+    traj->interleaves = dims[2];
+    traj->data.resize(traj->dimensions * traj->samples * traj->interleaves);
+    is.read((char *) traj->data.data(), traj->data.size() * sizeof(float));
+    if (!is) {
+        std::cerr << "WARNING: Trajectory cache file " << file.string() << " is truncated" << std::endl;
+        return boost::shared_ptr<const SpiralTrajectory>();
+    }
+    return traj;
+}
+
+// Like create_directories, the directories that are created are only accessible by the user
+static void createPrivateDirectories(const boost::filesystem::path &dir, boost::system::error_code &ec)
+{
+    if (dir.empty() || boost::filesystem::exists(dir, ec)) {
+        return;
+    }
+    createPrivateDirectories(dir.parent_path(), ec);
+    if (!ec && boost::filesystem::create_directory(dir, ec) && !ec) {
+        boost::filesystem::permissions(dir, boost::filesystem::owner_all, ec);
+    }
+}
+
+// Writes to a temporary file first, so that concurrent runs never see a partial file
+static void storeTrajectory(const boost::filesystem::path &file, const SpiralParameters &parameters,
+                            const SpiralTrajectory &traj)
+{
+    boost::system::error_code ec;
+    createPrivateDirectories(file.parent_path(), ec);
+    boost::filesystem::path tmp = file.parent_path() / boost::filesystem::unique_path("%%%%-%%%%-%%%%.tmp");
+
+    {
+        std::ofstream os(tmp.string().c_str(), std::ios::out | std::ios::binary);
+        uint64_t dims[3] = {traj.dimensions, traj.samples, traj.interleaves};
+        os.write(TRAJECTORY_FILE_MAGIC, sizeof(TRAJECTORY_FILE_MAGIC));
+        writeParameters(os, parameters);
+        os.write((const char *) dims, sizeof(dims));
+        os.write((const char *) traj.data.data(), traj.data.size() * sizeof(float));
+        if (!os) {
+            std::cerr << "WARNING: Failed to write trajectory cache file " << tmp.string() << std::endl;
+            os.close();
+            boost::filesystem::remove(tmp, ec);
+            return;
+        }
+    }
+
+    boost::filesystem::rename(tmp, file, ec);
+    if (ec) {
+        std::cerr << "WARNING: Failed to write trajectory cache file " << file.string() << ": " << ec.message()
+                  << std::endl;
+        boost::filesystem::remove(tmp, ec);
+    }
+}
+
+boost::shared_ptr<const SpiralTrajectory> cachedSpiralTrajectory(const SpiralParameters &parameters,
+                                                                 const std::string &cache_dir)
+{
+    static std::mutex mutex;
+    static std::map<SpiralParameters, boost::shared_ptr<const SpiralTrajectory> > trajectories;
+
+    // Held while computing, measurements that need the same trajectory wait for the first one
+    std::lock_guard<std::mutex> lock(mutex);
+
+    boost::shared_ptr<const SpiralTrajectory> &traj = trajectories[parameters];
+    if (traj) {
+        return traj;
+    }
+
+    boost::filesystem::path file;
+    if (!cache_dir.empty()) {
+        file = trajectoryCacheFile(parameters, cache_dir);
+        traj = loadTrajectory(file, parameters);
+        if (traj) {
+            std::cout << "Spiral trajectory read from " << file.string() << std::endl;
+            return traj;
+        }
+    }
+
+    traj = computeSpiralTrajectory(parameters);
+    std::cout << "Calculated spiral trajectory: " << traj->samples << " samples, " << traj->interleaves
+              << " interleaves" << std::endl;
+
+    if (!cache_dir.empty()) {
+        storeTrajectory(file, parameters, *traj);
+    }
+    return traj;
+}
+
+std::string defaultTrajectoryCacheDirectory()
+{
+    boost::filesystem::path cache;
+    const char *xdg_cache_home = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    if (xdg_cache_home && boost::filesystem::path(xdg_cache_home).is_absolute()) {
+        cache = xdg_cache_home;
+    } else if (home && boost::filesystem::path(home).is_absolute()) {
+        cache = boost::filesystem::path(home) / ".cache";
+    } else {
+        return std::string();
+    }
+    return (cache / "siemens_to_ismrmrd" / "trajectories").string();
+}
@@ -0,0 +1,57 @@
+#ifndef TRAJECTORYCACHE_H_
+#define TRAJECTORYCACHE_H_
+
+#include <boost/shared_ptr.hpp>
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/// Design parameters of a variable density spiral, from the WIP double parameters of the protocol
+struct SpiralParameters
+{
+    SpiralParameters();
+
+    double smax;      // Maximum slew rate, G/cm/s
+    double gmax;      // Maximum gradient, G/cm
+    double fov;       // cm
+    double krmax;     // cm^-1
+    long dwell_time;  // ns, used as gradient and acquisition sampling period
+    long interleaves;
+
+    bool operator<(const SpiralParameters &other) const;
+};
+
+/// Spiral k-space trajectory as attached by --attachTrajectory: x and y of every sample of every interleaf,
+/// scaled to -0.5..0.5
+struct SpiralTrajectory
+{
+    size_t dimensions; // Always 2
+    size_t samples;    // Per interleaf
+    size_t interleaves;
+    std::vector<float> data; // [interleaf][sample][dimension]
+
+    const float *interleaf(size_t i) const { return &data[i * samples * dimensions]; }
+};
+
+/// Reads the spiral parameters from the WIP double parameters (MEAS.sWipMemBlock.adFree).
+/// Throws std::runtime_error if the protocol does not have them.
+SpiralParameters spiralParameters(const std::vector<std::string> &wip_double, long dwell_time_0, long radial_views);
+
+/// Designs the k-space path of the first interleaf with calc_vds_kspace and rotates it into all
+/// interleaves with calc_vds_trajectory, scaled to -0.5..0.5
+boost::shared_ptr<const SpiralTrajectory> computeSpiralTrajectory(const SpiralParameters &parameters);
+
+/// Trajectory for the parameters, computed once per process and, if cache_dir is not empty, once per
+/// cache directory: computed trajectories are stored there and read back by later runs. A cache file
+/// that can not be read or written is reported and the trajectory is computed instead. Directories
+/// that are created for the cache are only accessible by the user.
+/// Safe to call from concurrently converted measurements.
+boost::shared_ptr<const SpiralTrajectory> cachedSpiralTrajectory(const SpiralParameters &parameters,
+                                                                 const std::string &cache_dir);
+
+/// Default for --trajectoryCache, a directory in the cache directory of the user ($XDG_CACHE_HOME or ~/.cache).
+/// Empty (memory only) if neither is set.
+std::string defaultTrajectoryCacheDirectory();
+
+#endif //TRAJECTORYCACHE_H_
@@ -1,10 +1,5 @@
 #include "XNode.h"
 
-#include <boost/spirit/include/phoenix_core.hpp>
-#include <boost/spirit/include/phoenix_operator.hpp>
-#include <boost/spirit/include/phoenix_fusion.hpp>
-#include <boost/spirit/include/phoenix_stl.hpp>
-#include <boost/fusion/include/adapt_struct.hpp>
 #include <boost/algorithm/string.hpp>
 #include <boost/foreach.hpp>
 
@@ -18,11 +13,7 @@ namespace XProtocol
 
 const XNode* getChildNodeByName::operator()(const XNodeParamArray& node) const {
 	unsigned int index = static_cast<unsigned int>(std::atoi(level_.c_str()));
-	const_cast<XNodeParamArray&>(node).expand_children();
-	const XNode* ret = 0;
-	if (index < node.children_.size()) {
-		ret =  &node.children_[index];
-	}
+	const XNode* ret = node.child(index);
 
 	if (!ret) {
 		return 0;
@@ -61,31 +52,86 @@ const XNode* getChildNodeByName::operator()(const XNodeParamValue& node) const {
 	return 0;
 }
 
-const XNode*  getChildNodeByIndex::operator()(const XNodeParamMap& node)
+// Lower case, with runs of '.' collapsed like getChildNodeByName does (token_compress_on)
+static std::string normalize_path(const std::string& path)
 {
-	const XNode* ret = 0;
-	if (node.children_.size() > index_) {
-		ret = &node.children_[index_];
+	std::string ret;
+	ret.reserve(path.size());
+	for (size_t i = 0; i < path.size(); i++) {
+		if (path[i] == '.' && i > 0 && path[i-1] == '.') {
+			continue;
+		}
+		ret += path[i];
 	}
+	boost::algorithm::to_lower(ret);
 	return ret;
 }
 
-const XNode*  getChildNodeByIndex::operator()(const XNodeParamArray& node)
+XNodeIndex::XNodeIndex(const XNode& root)
+: root_(root)
 {
-	const XNode* ret = 0;
-	if (node.children_.size() == 0) { //Children have not yet been expanded
-		if (!const_cast<XNodeParamArray&>(node).expand_children()) {
-			std::cout << "Failed to expand children" << std::endl;
+	if (const XNodeParamMap* map = boost::get<XNodeParamMap>(&root_)) {
+		add_children(*map, "");
+	}
+}
+
+void XNodeIndex::add_children(const XNodeParamMap& node, const std::string& prefix)
+{
+	BOOST_FOREACH(XNode const& cnode, node.children_) {
+		const std::string& name = boost::apply_visitor(getNodeName(), cnode);
+		if (name.find('.') != std::string::npos) {
+			continue; //Can not be reached with a dotted path
+		}
+		std::string key = prefix + boost::algorithm::to_lower_copy(name);
+		if (!nodes_.insert(std::make_pair(key, &cnode)).second) {
+			continue; //Only the first child with a given name can be found
+		}
+		if (const XNodeParamMap* map = boost::get<XNodeParamMap>(&cnode)) {
+			add_children(*map, key + ".");
+		}
+	}
+}
+
+const XNode* XNodeIndex::find(const std::string& path) const
+{
+	std::string key = normalize_path(path);
+
+	if (!boost::get<XNodeParamMap>(&root_)) {
+		return boost::apply_visitor(getChildNodeByName(key), root_);
+	}
+
+	std::unordered_map<std::string, const XNode*>::const_iterator it = nodes_.find(key);
+	if (it != nodes_.end()) {
+		return it->second;
+	}
+
+	//Not indexed, the path either does not exist or it goes through an array
+	for (size_t dot = key.find('.'); dot != std::string::npos; dot = key.find('.', dot + 1)) {
+		it = nodes_.find(key.substr(0, dot));
+		if (it == nodes_.end()) {
 			return 0;
 		}
+		if (boost::get<XNodeParamArray>(it->second)) {
+			return boost::apply_visitor(getChildNodeByName(key.substr(dot + 1)), *it->second);
+		}
 	}
+	return 0;
+}
+
+const XNode*  getChildNodeByIndex::operator()(const XNodeParamMap& node)
+{
+	const XNode* ret = 0;
 	if (node.children_.size() > index_) {
 		ret = &node.children_[index_];
 	}
-
 	return ret;
 }
 
+const XNode*  getChildNodeByIndex::operator()(const XNodeParamArray& node)
+{
+	return node.child(index_);
+}
+
 const XNode*  getChildNodeByIndex::operator()(const XNodeParamValue& node)
 {
 	return 0; //Param values do not have children
@@ -105,16 +151,10 @@ std::string getXMLString::operator()(const XNodeParamMap& node) const
 
 std::string getXMLString::operator()(const XNodeParamArray& node) const
 {
-	if (node.children_.size() == 0) { //Children have not yet been expanded
-		if (!const_cast<XNodeParamArray&>(node).expand_children()) {
-			std::cout << "Failed to expand children" << std::endl;
-			return 0;
-		}
-	}
 	std::stringstream str;
 	str << "<" << node.name_ << ">" << std::endl;
-	BOOST_FOREACH(XNode const& cnode, node.children_) {
-		str << boost::apply_visitor(getXMLString(), cnode);
+	for (size_t i = 0; i < node.size(); i++) {
+		str << boost::apply_visitor(getXMLString(), *node.child(i));
 	}
 	/*
 	for (unsigned int i = 0; i < node.values_.size(); i++) {
@@ -153,11 +193,9 @@ bool setNodeValues :: operator()(XNodeParamMap& node) {
 }
 
 bool setNodeValues :: operator()(XNodeParamArray& node) {
-	node.values_.clear();
-	for (unsigned int i = 0; i < val_.children_.size(); i++) {
-		node.values_.push_back(val_.children_[i]);
-	}
-	node.expand_children();
+	//The elements are created from the new values when they are addressed
+	node.values_ = val_.children_;
+	node.children_.clear();
 	return true;
 }
 
@@ -170,21 +208,25 @@ bool setNodeValues :: operator()(XNodeParamValue& node) {
 	return true;
 }
 
-bool XNodeParamArray :: expand_children() {
-	if (!children_.size()) {
-		for (unsigned int i = 0; i < values_.size(); i++) {
-			children_.push_back(default_);
-			if (values_[i].values_.size() == 0 && values_[i].children_.size()==0) { //Empty values container, occurs sometimes in the files.
-				//std::cout << "Empty container encountered, " << name_ << std::endl;
-				continue;
-			}
-			setNodeValues tmp(values_[i]);
-			if (!boost::apply_visitor(tmp, children_[i])) {
-				return false;
-			}
-		}
+const XNode* XNodeParamArray :: child(size_t i) const {
+	if (i >= values_.size()) {
+		return 0;
 	}
-	return true;
+	if (values_[i].values_.size() == 0 && values_[i].children_.size() == 0) { //Empty values container, occurs sometimes in the files.
+		return &default_;
+	}
+	if (children_.size() < values_.size()) {
+		children_.resize(values_.size());
+	}
+	if (!children_[i]) {
+		//Copies of the default share the elements it has created so far, they do not depend on the copy
+		//Values that do not fit the default are reported by setNodeValues, the ones that do are kept
+		boost::shared_ptr<XNode> element(new XNode(default_));
+		setNodeValues tmp(values_[i]);
+		boost::apply_visitor(tmp, *element);
+		children_[i] = element;
+	}
+	return children_[i].get();
 }
 
 std::vector<std::string> getStringValueArray::operator()(const XNodeParamArray& node) const
@@ -1,29 +1,18 @@
 #ifndef XNODE_H
 #define XNODE_H
 
-#define  BOOST_SPIRIT_DEBUG
-#define BOOST_SPIRIT_DEBUG_PRINT_SOME 500
-#include <boost/spirit/include/phoenix_core.hpp>
-#include <boost/spirit/include/phoenix_operator.hpp>
-#include <boost/spirit/include/phoenix_fusion.hpp>
-#include <boost/spirit/include/phoenix_stl.hpp>
-#include <boost/fusion/include/adapt_struct.hpp>
+#include <boost/variant.hpp>
 #include <boost/variant/recursive_variant.hpp>
-#include <boost/spirit/include/qi.hpp>
 #include <boost/algorithm/string.hpp>
 
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include <boost/shared_ptr.hpp>
 
 namespace XProtocol
 {
-namespace fusion = boost::fusion;
-namespace phoenix = boost::phoenix;
-namespace qi = boost::spirit::qi;
-namespace ascii = boost::spirit::ascii;
-
 typedef
 		boost::variant<
 		std::string
@@ -63,15 +52,22 @@ struct XNodeParamMap
 	std::vector<XNode> children_;
 };
 
+/// The elements of an array are default_ with the values of values_[i] applied. They are only created
+/// when child() addresses them; an element without values is default_ itself.
 struct XNodeParamArray
 {
 	std::string name_;
 	std::string type_;
 	XNode default_;
 	std::vector<XNodeArrayValue> values_;
-	std::vector<XNode> children_;
 
-	bool expand_children();
+	size_t size() const { return values_.size(); }
+
+	/// Element i, 0 if i >= size()
+	const XNode* child(size_t i) const;
+
+	/// Elements created so far, indexed like values_ (shorter or null if not created yet)
+	mutable std::vector< boost::shared_ptr<const XNode> > children_;
 };
 
 int ParseXProtocol(const std::string& input, XNode& tree);
@@ -147,6 +143,23 @@ protected:
 	bool has_sublevels_;
 };
 
+/// Case insensitive path -> node index of a parsed tree, built once so that repeated lookups neither split
+/// the path nor scan the children of every level. find() returns the same node as getChildNodeByName.
+/// Maps are indexed up front; paths that go through an array are looked up with getChildNodeByName,
+/// which only creates the array element they address.
+/// The tree must outlive the index.
+class XNodeIndex {
+public:
+	XNodeIndex(const XNode& root);
+
+	const XNode* find(const std::string& path) const;
+
+protected:
+	void add_children(const XNodeParamMap& node, const std::string& prefix);
+
+	const XNode& root_;
+	std::unordered_map<std::string, const XNode*> nodes_;
+};
 
 class getTypeName : public boost::static_visitor<std::string> {
 public:
@@ -181,33 +194,4 @@ public:
 
 }
 
-BOOST_FUSION_ADAPT_STRUCT(
-		XProtocol::XNodeParamMap,
-		(std::string, name_)
-		(std::string, type_)
-		(std::vector<XProtocol::XNode>, children_)
-)
-
-BOOST_FUSION_ADAPT_STRUCT(
-		XProtocol::XNodeParamArray,
-		(std::string, name_)
-		(std::string, type_)
-		(XProtocol::XNode, default_)
-		(std::vector<XProtocol::XNodeArrayValue>, values_)
-		(std::vector<XProtocol::XNode>, children_)
-)
-
-BOOST_FUSION_ADAPT_STRUCT(
-		XProtocol::XNodeArrayValue,
-		(std::vector<XProtocol::XNodeValueVariant>, values_)
-		(std::vector<XProtocol::XNodeArrayValue>, children_)
-)
-
-BOOST_FUSION_ADAPT_STRUCT(
-		XProtocol::XNodeParamValue,
-		(std::string, name_)
-		(std::string, type_)
-		(std::vector<XProtocol::XNodeValueVariant>, values_)
-)
-
 #endif //XNODE_H
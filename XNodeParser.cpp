@@ -1,178 +1,596 @@
 #include "XNode.h"
 
 #include <iostream>
+#include <cstring>
 
-#include <boost/bind.hpp>
+#include <boost/spirit/include/qi_numeric.hpp>
+#include <boost/spirit/include/qi_parse.hpp>
 
 namespace XProtocol
 {
 
-    template <typename Iterator>
-    struct XNodeGrammar : qi::grammar<Iterator, XNodeParamMap(), ascii::space_type>
+    // Recursive descent parser for the XProtocol format.
+    //
+    // The parser accepts exactly what the former Boost.Spirit grammar accepted and builds the same
+    // tree. Every rule below is annotated with the grammar rule it replaces. As with the grammar,
+    // whitespace is skipped before every token, and each rule leaves the position untouched when it
+    // fails. The alternatives of a node are picked by their leading literal, so the parser only backs
+    // up where the grammar would have fallen back to another alternative, e.g. an empty
+    // <ParamMap."x"> { } which is accepted as a generic parameter.
+    //
+    // Numbers are converted with the Spirit numeric primitives, which are cheap and guarantee the
+    // same values and the same accepted spellings (nan, inf, 1e5 vs. 1.0e5, ...) as before.
+    class XProtocolParser
     {
-        XNodeGrammar() : XNodeGrammar::base_type(xprot)
-        {
-            using qi::lit;
-            using qi::lexeme;
-            using ascii::char_;
-            using ascii::string;
-            using namespace qi::labels;
-            using boost::spirit::long_;
-            using boost::spirit::double_;
-            using boost::spirit::qi::real_parser;
-            using boost::spirit::qi::strict_real_policies;
-            using boost::spirit::_1;
-
-            using phoenix::at_c;
-            using phoenix::push_back;
-
-            node = (param_map | param_array | param_generic)[_val = _1];
-
-            burn_properties =
-                ((lit("<Default>") >> double_)
-                    | (lit("<Default>") >> long_)
-                    | (lit("<Default>") >> quoted_string)
-                    | (lit("<Precision>") >> long_)
-                    | (lit("<MinSize>") >> long_)
-                    | (lit("<MaxSize>") >> long_)
-                    | (lit("<Comment>") >> quoted_string)
-                    | (lit("<Visible>") >> quoted_string)
-                    | (lit("<Tooltip>") >> quoted_string)
-                    | (lit("<Class>") >> quoted_string)
-                    | (lit("<Label>") >> quoted_string)
-                    | (lit("<Unit>") >> quoted_string)
-                    | (lit("<InFile>") >> quoted_string)
-                    | (lit("<Dll>") >> quoted_string)
-                    | (lit("<Repr>") >> quoted_string)
-                    | (lit("<LimitRange>") >> '{' >> *(quoted_string | long_ | double_) >> '}')
-                    | (lit("<Limit>") >> '{' >> *(quoted_string | long_ | double_) >> '}')
-                    ) //Burn this
-                ;
-
-            burn_param_card_layout =
-                //				lit("<ParamCardLayout.\"Inline Evaluation\">")
-                lit("<ParamCardLayout.") >> quoted_string >> '>'
-                >> '{'
-                >> lit("<Repr>") >> quoted_string
-                >> *(lit("<Control>  {") >> lexeme[+(char_ - '}')] >> '}')
-                >> *(lit("<Line>  {") >> lexeme[+(char_ - '}')] >> '}')
-                >> '}'
-                ;
-
-            burn_dependency =
-                ((lit("<Dependency.") | lit("<ProtocolComposer."))
-                    >> quoted_string
-                    >> '>'
-                    >> '{'
-                    >> lexeme[+(char_ - '}')] >> '}')
-                ;
-
-            quoted_string =
-                '"' >> lexeme[*(char_ - '"')[_val += _1]] >> '"';
-
-            param_generic =
-                '<'
-                >> lexeme[+(char_ - '.')[at_c<1>(_val) += _1]] >> '.'
-                //		  >> quoted_string[std::cout << "GENERIC: " << at_c<1>(_val) << ", " << (at_c<0>(_val) = _1) << std::endl]
-                >> quoted_string[at_c<0>(_val) = _1]
-                >> '>' >> '{'
-                >> *burn_properties
-                >> *((quoted_string[push_back(at_c<2>(_val), _1)]) | (strict_double[push_back(at_c<2>(_val), _1)]) | (long_[push_back(at_c<2>(_val), _1)]) | (lit("<Line>  {") >> *(char_ - '}') >> '}'))
-                >> '}'
-                ;
-
-            array_value =
-                '{'
-                >> *burn_properties
-                >> ((*array_value[push_back(at_c<1>(_val), _1)] >> '}') |
-                (*quoted_string[push_back(at_c<0>(_val), _1)] >> '}') |
-                    (*double_[push_back(at_c<0>(_val), _1)] >> '}'))
-                ;
-
-            param_array =
-                lit("<ParamArray.")[at_c<1>(_val) = std::string("ParamArray")]
-                >> quoted_string[at_c<0>(_val) = _1]
-                //				                    >> quoted_string[std::cout << "ARRAY: " << at_c<1>(_val) << ", " << _1 << std::endl]
-                >> '>' >> '{'
-                >> *((lit("<Visible>") >> quoted_string) | (lit("<DefaultSize>") >> long_) | (lit("<MinSize>") >> long_) | (lit("<Label>") >> quoted_string) | (lit("<MaxSize>") >> long_) | (lit("<Comment>") >> quoted_string)) //Burn this
-                >> lit("<Default>")
-                >> node[at_c<2>(_val) = _1]
-                >> *array_value[push_back(at_c<3>(_val), _1)]
-                >> '}'
-                ;
-
-            param_map =
-                (lit("<ParamMap.\"")[at_c<1>(_val) = std::string("ParamMap")] |
-                    lit("<Pipe.\"")[at_c<1>(_val) = std::string("Pipe")] |
-                    lit("<PipeService.\"")[at_c<1>(_val) = std::string("PipeService")] |
-                    lit("<ParamFunctor.\"")[at_c<1>(_val) = std::string("ParamFunctor")])
-                >> lexeme[*(char_ - '"')[at_c<0>(_val) += _1]]
-                >> '"' >> '>' >> '{'
-                >> *burn_properties
-                >> +node[push_back(at_c<2>(_val), _1)]
-                >> '}'
-                ;
-
-            xprot =
-                lit("<XProtocol>")[at_c<1>(_val) = std::string("XProtocol")]
-                >> '{'
-                >> *(lit("<Name>") >> quoted_string)                                   //Burn this
-                >> *(lit("<ID>") >> long_)                                             //Burn this
-                >> *(lit("<Userversion>") >> lexeme[*(char_ - '\n')])                  //Burn this
-                >> *(lit("<EVAStringTable>") >> '{' >> lexeme[+(char_ - '}')] >> '}') //Burn this
-                >> +node[push_back(at_c<2>(_val), _1)]
-                >> *burn_param_card_layout
-                >> *burn_dependency
-                >> '}';
-            //		BOOST_SPIRIT_DEBUG_NODEnode);
-            //		BOOST_SPIRIT_DEBUG_NODE(param_map);
-            //		BOOST_SPIRIT_DEBUG_NODE(param_array);
-                //		BOOST_SPIRIT_DEBUG_NODE(param_generic);
-            //		BOOST_SPIRIT_DEBUG_NODE(quoted_string);
-            //        BOOST_SPIRIT_DEBUG_NODE(xprot);
-            //		BOOST_SPIRIT_DEBUG_NODE(array_value);
-            //		BOOST_SPIRIT_DEBUG_NODE(burn_properties);
-            //		BOOST_SPIRIT_DEBUG_NODE(burn_dependency);
-            //		BOOST_SPIRIT_DEBUG_NODE(burn_param_card_layout);
-
-
-
-        }
-
-        qi::rule<Iterator, XNodeParamMap(), ascii::space_type> xprot;
-        qi::rule<Iterator, XNodeParamMap(), ascii::space_type> param_map;
-        qi::rule<Iterator, XNodeParamArray(), ascii::space_type> param_array;
-        qi::rule<Iterator, XNode(), ascii::space_type> node;
-        qi::rule<Iterator, XNodeParamValue(), ascii::space_type> param_generic;
-        qi::rule<Iterator, std::string(), ascii::space_type> quoted_string;
-        qi::rule<Iterator, XNodeArrayValue(), ascii::space_type> array_value;
-        qi::rule<Iterator, void(), ascii::space_type> burn_properties;
-        qi::rule<Iterator, void(), ascii::space_type> burn_param_card_layout;
-        qi::rule<Iterator, void(), ascii::space_type> burn_dependency;
-        qi::rule<Iterator, void(), ascii::space_type> burn_protocol_composer;
-        qi::real_parser<double, qi::strict_real_policies<double> > strict_double;
+    public:
+        XProtocolParser(const char *begin, const char *end)
+            : pos_(begin)
+            , end_(end)
+        {
+        }
+
+        const char *position() const { return pos_; }
+
+        // The grammar works with ascii::space, which only knows these characters
+        static bool is_space(char c)
+        {
+            return c == ' ' || (c >= '\t' && c <= '\r');
+        }
+
+        // ascii::char_ does not match bytes outside of the 7 bit range
+        static bool is_ascii(char c)
+        {
+            return (static_cast<unsigned char>(c) & 0x80) == 0;
+        }
+
+        void skip()
+        {
+            while (pos_ != end_ && is_space(*pos_)) {
+                ++pos_;
+            }
+        }
+
+        // Position to back up to if a rule fails. Every token starts by skipping whitespace, so it is skipped
+        // here already; otherwise it is scanned again by each alternative that is tried after backing up.
+        const char *mark()
+        {
+            skip();
+            return pos_;
+        }
+
+        // lit("...")
+        bool lit(const char *s, size_t len)
+        {
+            skip();
+            if (static_cast<size_t>(end_ - pos_) < len || memcmp(pos_, s, len) != 0) {
+                return false;
+            }
+            pos_ += len;
+            return true;
+        }
+
+        template <size_t N> bool lit(const char (&s)[N])
+        {
+            return lit(s, N - 1);
+        }
+
+        // '.'
+        bool lit(char c)
+        {
+            skip();
+            if (pos_ == end_ || *pos_ != c) {
+                return false;
+            }
+            ++pos_;
+            return true;
+        }
+
+        // Whether the next token starts with s, without consuming anything
+        template <size_t N> bool peek(const char (&s)[N])
+        {
+            skip();
+            return static_cast<size_t>(end_ - pos_) >= N - 1 && memcmp(pos_, s, N - 1) == 0;
+        }
 
+        // lexeme[*(char_ - stop)] or, with at_least_one, lexeme[+(char_ - stop)]
+        bool lexeme_until(char stop, bool at_least_one, std::string *out)
+        {
+            skip();
+            const char *start = pos_;
+            while (pos_ != end_ && *pos_ != stop && is_ascii(*pos_)) {
+                ++pos_;
+            }
+            if (at_least_one && pos_ == start) {
+                return false;
+            }
+            if (out) {
+                out->append(start, pos_);
+            }
+            return true;
+        }
+
+        // quoted_string = '"' >> lexeme[*(char_ - '"')] >> '"'
+        bool quoted_string(std::string *out)
+        {
+            const char *save = mark();
+            std::string value;
+            if (lit('"') && lexeme_until('"', false, out ? &value : NULL) && lit('"')) {
+                if (out) {
+                    out->swap(value);
+                }
+                return true;
+            }
+            pos_ = save;
+            return false;
+        }
+
+        // long_
+        bool long_value(long *out)
+        {
+            namespace qi = boost::spirit::qi;
+            skip();
+            const char *it = pos_;
+            long value;
+            if (!qi::parse(it, end_, qi::long_, value)) {
+                return false;
+            }
+            pos_ = it;
+            if (out) {
+                *out = value;
+            }
+            return true;
+        }
+
+        // double_, or strict_double (which requires a '.' or an exponent).
+        // When the exponent overflows, Spirit fails but leaves the iterator behind the number; this is kept
+        // so that values such as 2e400 are silently skipped in a value list, as they always have been.
+        bool double_value(bool strict, double *out)
+        {
+            namespace qi = boost::spirit::qi;
+            skip();
+            const char *it = pos_;
+            double value;
+            bool r;
+            if (strict) {
+                r = qi::parse(it, end_, qi::real_parser<double, qi::strict_real_policies<double> >(), value);
+            } else {
+                r = qi::parse(it, end_, qi::double_, value);
+            }
+            pos_ = it;
+            if (!r) {
+                return false;
+            }
+            if (out) {
+                *out = value;
+            }
+            return true;
+        }
+
+        // quoted_string | long_ | double_, as used in <Limit> and <LimitRange>
+        bool limit_value()
+        {
+            return quoted_string(NULL) || long_value(NULL) || double_value(false, NULL);
+        }
 
+        // burn_properties
+        bool burn_properties()
+        {
+            if (!peek("<")) {
+                return false;
+            }
+
+            const char *save = mark();
+            if (lit("<Default>")) {
+                const char *value = mark();
+                if (double_value(false, NULL)) {
+                    return true;
+                }
+                pos_ = value;
+                if (long_value(NULL) || quoted_string(NULL)) {
+                    return true;
+                }
+                pos_ = save;
+                return false;
+            }
+
+            if (lit("<Precision>") || lit("<MinSize>") || lit("<MaxSize>")) {
+                if (long_value(NULL)) {
+                    return true;
+                }
+                pos_ = save;
+                return false;
+            }
+
+            if (lit("<Comment>") || lit("<Visible>") || lit("<Tooltip>") || lit("<Class>") || lit("<Label>") ||
+                lit("<Unit>") || lit("<InFile>") || lit("<Dll>") || lit("<Repr>")) {
+                if (quoted_string(NULL)) {
+                    return true;
+                }
+                pos_ = save;
+                return false;
+            }
+
+            if (lit("<LimitRange>") || lit("<Limit>")) {
+                if (lit('{')) {
+                    while (limit_value()) {
+                    }
+                    if (lit('}')) {
+                        return true;
+                    }
+                }
+                pos_ = save;
+                return false;
+            }
+
+            pos_ = save;
+            return false;
+        }
+
+        // burn_param_card_layout
+        bool burn_param_card_layout()
+        {
+            const char *save = mark();
+            if (lit("<ParamCardLayout.") && quoted_string(NULL) && lit('>') && lit('{') && lit("<Repr>") &&
+                quoted_string(NULL)) {
+                for (;;) {
+                    const char *item = mark();
+                    if (!(lit("<Control>  {") && lexeme_until('}', true, NULL) && lit('}'))) {
+                        pos_ = item;
+                        break;
+                    }
+                }
+                for (;;) {
+                    const char *item = mark();
+                    if (!(lit("<Line>  {") && lexeme_until('}', true, NULL) && lit('}'))) {
+                        pos_ = item;
+                        break;
+                    }
+                }
+                if (lit('}')) {
+                    return true;
+                }
+            }
+            pos_ = save;
+            return false;
+        }
+
+        // burn_dependency
+        bool burn_dependency()
+        {
+            const char *save = mark();
+            if ((lit("<Dependency.") || lit("<ProtocolComposer.")) && quoted_string(NULL) && lit('>') && lit('{') &&
+                lexeme_until('}', true, NULL) && lit('}')) {
+                return true;
+            }
+            pos_ = save;
+            return false;
+        }
+
+        // param_generic
+        bool param_generic(XNodeParamValue &val)
+        {
+            const char *save = mark();
+            if (!(lit('<') && lexeme_until('.', true, &val.type_) && lit('.') && quoted_string(&val.name_) &&
+                  lit('>') && lit('{'))) {
+                pos_ = save;
+                return false;
+            }
+
+            while (burn_properties()) {
+            }
+
+            for (;;) {
+                std::string s;
+                double d;
+                long l;
+                if (quoted_string(&s)) {
+                    val.values_.push_back(XNodeValueVariant());
+                    boost::get<std::string>(val.values_.back()).swap(s);
+                } else if (double_value(true, &d)) {
+                    val.values_.push_back(d);
+                } else if (long_value(&l)) {
+                    val.values_.push_back(l);
+                } else {
+                    // lit("<Line>  {") >> *(char_ - '}') >> '}', where the skipper stays active
+                    const char *item = mark();
+                    if (!lit("<Line>  {")) {
+                        pos_ = item;
+                        break;
+                    }
+                    for (;;) {
+                        skip();
+                        if (pos_ == end_ || *pos_ == '}' || !is_ascii(*pos_)) {
+                            break;
+                        }
+                        ++pos_;
+                    }
+                    if (!lit('}')) {
+                        pos_ = item;
+                        break;
+                    }
+                }
+            }
+
+            if (!lit('}')) {
+                pos_ = save;
+                return false;
+            }
+            return true;
+        }
+
+        // array_value
+        bool array_value(XNodeArrayValue &val)
+        {
+            const char *save = mark();
+            if (!lit('{')) {
+                pos_ = save;
+                return false;
+            }
+
+            while (burn_properties()) {
+            }
+
+            // Like the grammar, the values pushed by an alternative that fails are not removed again
+            const char *alt = mark();
+            while (peek("{")) {
+                val.children_.push_back(XNodeArrayValue());
+                if (!array_value(val.children_.back())) {
+                    val.children_.pop_back();
+                    break;
+                }
+            }
+            if (lit('}')) {
+                return true;
+            }
+
+            pos_ = alt;
+            std::string s;
+            while (quoted_string(&s)) {
+                val.values_.push_back(XNodeValueVariant());
+                boost::get<std::string>(val.values_.back()).swap(s);
+            }
+            if (lit('}')) {
+                return true;
+            }
+
+            pos_ = alt;
+            double d;
+            while (double_value(false, &d)) {
+                val.values_.push_back(d);
+            }
+            if (lit('}')) {
+                return true;
+            }
+
+            pos_ = save;
+            return false;
+        }
+
+        // One of (<Visible> quoted) | (<DefaultSize> long_) | ... in front of the <Default> of a param_array
+        bool burn_array_property()
+        {
+            const char *save = mark();
+            if (lit("<Visible>") || lit("<Label>") || lit("<Comment>")) {
+                if (quoted_string(NULL)) {
+                    return true;
+                }
+            } else if (lit("<DefaultSize>") || lit("<MinSize>") || lit("<MaxSize>")) {
+                if (long_value(NULL)) {
+                    return true;
+                }
+            }
+            pos_ = save;
+            return false;
+        }
+
+        // param_array
+        bool param_array(XNodeParamArray &val)
+        {
+            const char *save = mark();
+            if (!lit("<ParamArray.")) {
+                return false;
+            }
+            val.type_ = "ParamArray";
+
+            if (!(quoted_string(&val.name_) && lit('>') && lit('{'))) {
+                pos_ = save;
+                return false;
+            }
+
+            while (burn_array_property()) {
+            }
+
+            if (!(lit("<Default>") && node(val.default_))) {
+                pos_ = save;
+                return false;
+            }
+
+            while (peek("{")) {
+                val.values_.push_back(XNodeArrayValue());
+                if (!array_value(val.values_.back())) {
+                    val.values_.pop_back();
+                    break;
+                }
+            }
+
+            if (!lit('}')) {
+                pos_ = save;
+                return false;
+            }
+            return true;
+        }
+
+        // param_map
+        bool param_map(XNodeParamMap &val)
+        {
+            const char *save = mark();
+            if (lit("<ParamMap.\"")) {
+                val.type_ = "ParamMap";
+            } else if (lit("<Pipe.\"")) {
+                val.type_ = "Pipe";
+            } else if (lit("<PipeService.\"")) {
+                val.type_ = "PipeService";
+            } else if (lit("<ParamFunctor.\"")) {
+                val.type_ = "ParamFunctor";
+            } else {
+                pos_ = save;
+                return false;
+            }
+
+            lexeme_until('"', false, &val.name_);
+            if (!(lit('"') && lit('>') && lit('{'))) {
+                pos_ = save;
+                return false;
+            }
+
+            while (burn_properties()) {
+            }
+
+            if (!child_nodes(val.children_)) {
+                pos_ = save;
+                return false;
+            }
+
+            if (!lit('}')) {
+                pos_ = save;
+                return false;
+            }
+            return true;
+        }
+
+        // +node
+        bool child_nodes(std::vector<XNode> &children)
+        {
+            bool any = false;
+            while (peek("<")) {
+                if (children.size() == children.capacity()) {
+                    grow(children);
+                }
+                children.push_back(XNodeParamValue());
+                if (!node(children.back())) {
+                    children.pop_back();
+                    break;
+                }
+                any = true;
+            }
+            return any;
+        }
+
+        // The move constructor of XNode is not noexcept (recursive_wrapper allocates), so std::vector would
+        // copy every subtree when it reallocates. Moving the nodes over by hand keeps that cheap.
+        static void grow(std::vector<XNode> &nodes)
+        {
+            std::vector<XNode> grown;
+            grown.reserve(nodes.empty() ? 8 : 2 * nodes.size());
+            for (size_t i = 0; i < nodes.size(); i++) {
+                grown.push_back(std::move(nodes[i]));
+            }
+            nodes.swap(grown);
+        }
+
+        // node = param_map | param_array | param_generic
+        // The node is parsed in place, so big subtrees are never copied
+        bool node(XNode &out)
+        {
+            if (!peek("<")) {
+                return false;
+            }
+
+            if (peek("<ParamMap.\"") || peek("<Pipe.\"") || peek("<PipeService.\"") || peek("<ParamFunctor.\"")) {
+                out = XNodeParamMap();
+                if (param_map(boost::get<XNodeParamMap>(out))) {
+                    return true;
+                }
+                out = XNodeParamValue();
+            } else if (peek("<ParamArray.")) {
+                out = XNodeParamArray();
+                if (param_array(boost::get<XNodeParamArray>(out))) {
+                    return true;
+                }
+                out = XNodeParamValue();
+            } else if (!boost::get<XNodeParamValue>(&out)) {
+                out = XNodeParamValue();
+            }
+
+            return param_generic(boost::get<XNodeParamValue>(out));
+        }
+
+        // xprot
+        bool xprot(XNodeParamMap &val)
+        {
+            if (!lit("<XProtocol>")) {
+                return false;
+            }
+            val.type_ = "XProtocol";
+
+            if (!lit('{')) {
+                return false;
+            }
+
+            for (;;) {
+                const char *item = mark();
+                if (!(lit("<Name>") && quoted_string(NULL))) {
+                    pos_ = item;
+                    break;
+                }
+            }
+            for (;;) {
+                const char *item = mark();
+                if (!(lit("<ID>") && long_value(NULL))) {
+                    pos_ = item;
+                    break;
+                }
+            }
+            for (;;) {
+                const char *item = mark();
+                if (!lit("<Userversion>")) {
+                    pos_ = item;
+                    break;
+                }
+                lexeme_until('\n', false, NULL);
+            }
+            for (;;) {
+                const char *item = mark();
+                if (!(lit("<EVAStringTable>") && lit('{') && lexeme_until('}', true, NULL) && lit('}'))) {
+                    pos_ = item;
+                    break;
+                }
+            }
+
+            if (!child_nodes(val.children_)) {
+                return false;
+            }
+
+            while (burn_param_card_layout()) {
+            }
+            while (burn_dependency()) {
+            }
+
+            return lit('}');
+        }
+
+    private:
+        const char *pos_;
+        const char *end_;
     };
 
     int ParseXProtocol(const std::string& input, XNode& output)
     {
-        typedef XProtocol::XNodeGrammar<std::string::const_iterator> XNodeGrammar;
-        XNodeGrammar xprot; // Our grammar
-        //XProtocol::XNode ast; // Our tree
-        using boost::spirit::ascii::space;
-        std::string::const_iterator iter = input.begin();
-        std::string::const_iterator end = input.end();
-        bool r = phrase_parse(iter, end, xprot, space, boost::get<XProtocol::XNodeParamMap>(output));
+        const char *begin = input.data();
+        const char *end = begin + input.size();
+
+        XProtocolParser parser(begin, end);
+        bool r = parser.xprot(boost::get<XProtocol::XNodeParamMap>(output));
+        parser.skip();
 
-        if (!r || (iter != end))
+        if (!r || (parser.position() != end))
         {
             std::cout << input << std::endl;
             return -1;
         }
 
-        XProtocol::XNodeParamMap t = boost::get<XProtocol::XNodeParamMap>(boost::get<XProtocol::XNodeParamMap>(output).children_[0]);
-        output = t;
+        XProtocol::XNodeParamMap t = std::move(boost::get<XProtocol::XNodeParamMap>(boost::get<XProtocol::XNodeParamMap>(output).children_[0]));
+        output = std::move(t);
         return 0;
     }
 
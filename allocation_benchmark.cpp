@@ -0,0 +1,270 @@
+// Counts the heap allocations of the scan loop: a synthetic VB file is converted by MeasurementReader, with the
+// acquisitions taken from an AcquisitionPool and written through DatasetSink/DatasetWriter into a temporary HDF5
+// file, the way convertMeasurement does it. operator new is replaced by a counting version; the allocations made by
+// the C libraries (ISMRMRD's data buffers, HDF5) go through malloc and are not counted.
+//
+// Once the first half of the readouts is converted, every acquisition the writer can hold at once exists and the
+// loop is in its steady state. Returns 1 if the second half allocates with the writer on the calling thread
+// (--writerQueue 0). With the writer thread the number of acquisitions in flight depends on the scheduling, a late
+// stall of the writer can still grow the pool, so that run is only reported.
+
+#include "MeasurementReader.h"
+#include "MeasurementSink.h"
+#include "benchmark_fixtures.h"
+
+#include <boost/make_shared.hpp>
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <string>
+
+static std::atomic<unsigned long> allocations(0);
+
+void *operator new(size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    void *p = malloc(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return malloc(size ? size : 1);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &tag) noexcept
+{
+    return operator new(size, tag);
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, const std::nothrow_t &) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t &) noexcept
+{
+    free(p);
+}
+
+const unsigned int READOUTS = 2000;
+const uint16_t SAMPLES = 256;
+const uint16_t CHANNELS = 4;
+
+// The parts of the Meas buffer that readXmlConfig requires
+static const char meas_buffer[] =
+    "<XProtocol>\n"
+    "{\n"
+    "  <Name> \"PhoenixMetaProtocol\"\n"
+    "  <ParamMap.\"\">\n"
+    "  {\n"
+    "    <ParamMap.\"MEAS\">\n"
+    "    {\n"
+    "      <ParamMap.\"sWipMemBlock\">\n"
+    "      {\n"
+    "        <ParamLong.\"alFree\"> { 0 }\n"
+    "        <ParamDouble.\"adFree\"> { 0.0 }\n"
+    "      }\n"
+    "      <ParamMap.\"sRXSPEC\">\n"
+    "      {\n"
+    "        <ParamLong.\"alDwellTime\"> { 2500 }\n"
+    "      }\n"
+    "      <ParamMap.\"sKSpace\">\n"
+    "      {\n"
+    "        <ParamLong.\"ucTrajectory\"> { 1 }\n"
+    "        <ParamLong.\"lPhaseEncodingLines\"> { 128 }\n"
+    "        <ParamLong.\"lPartitions\"> { 1 }\n"
+    "        <ParamLong.\"lRadialViews\"> { 0 }\n"
+    "      }\n"
+    "    }\n"
+    "    <ParamMap.\"YAPS\">\n"
+    "    {\n"
+    "      <ParamLong.\"iMaxNoOfRxChannels\"> { 4 }\n"
+    "      <ParamLong.\"iNoOfFourierLines\"> { 128 }\n"
+    "    }\n"
+    "    <ParamMap.\"HEADER\">\n"
+    "    {\n"
+    "      <ParamString.\"tProtocolName\"> { \"AllocationBenchmark\" }\n"
+    "    }\n"
+    "  }\n"
+    "}\n";
+
+static const char parameter_map[] =
+    "<?xml version=\"1.0\" ?>\n"
+    "<siemens>\n"
+    "  <parameters>\n"
+    "    <p><s>HEADER.tProtocolName</s><d>siemens.HEADER.tProtocolName</d></p>\n"
+    "  </parameters>\n"
+    "</siemens>\n";
+
+// A fixed header, the benchmark is about the scan loop
+static const char parameter_stylesheet[] =
+    "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+    "<xsl:stylesheet version=\"1.0\" xmlns:xsl=\"http://www.w3.org/1999/XSL/Transform\">\n"
+    "<xsl:output method=\"xml\" indent=\"yes\"/>\n"
+    "<xsl:template match=\"/\">\n"
+    "<ismrmrdHeader xmlns=\"http://www.ismrm.org/ISMRMRD\">\n"
+    "  <experimentalConditions><H1resonanceFrequency_Hz>63500000</H1resonanceFrequency_Hz></experimentalConditions>\n"
+    "  <encoding>\n"
+    "    <encodedSpace>\n"
+    "      <matrixSize><x>256</x><y>128</y><z>1</z></matrixSize>\n"
+    "      <fieldOfView_mm><x>300</x><y>300</y><z>5</z></fieldOfView_mm>\n"
+    "    </encodedSpace>\n"
+    "    <reconSpace>\n"
+    "      <matrixSize><x>128</x><y>128</y><z>1</z></matrixSize>\n"
+    "      <fieldOfView_mm><x>300</x><y>300</y><z>5</z></fieldOfView_mm>\n"
+    "    </reconSpace>\n"
+    "    <encodingLimits>\n"
+    "      <kspace_encoding_step_1><minimum>0</minimum><maximum>127</maximum><center>64</center></kspace_encoding_step_1>\n"
+    "    </encodingLimits>\n"
+    "    <trajectory>cartesian</trajectory>\n"
+    "  </encoding>\n"
+    "</ismrmrdHeader>\n"
+    "</xsl:template>\n"
+    "</xsl:stylesheet>\n";
+
+static void write_file(const std::string &filename, const char *contents)
+{
+    std::ofstream f(filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    f << contents;
+}
+
+// A VB file with the Meas buffer and READOUTS readouts of CHANNELS x SAMPLES. The measurement ends at the end of
+// the file, without an ACQEND scan.
+static void write_vb_file(const std::string &filename)
+{
+    SyntheticVBFile file(filename, "Meas", meas_buffer);
+
+    std::vector<float> samples(2 * SAMPLES);
+    for (unsigned int n = 0; n < READOUTS; n++) {
+        sMDH mdh;
+        memset(&mdh, 0, sizeof(mdh));
+        mdh.ulFlagsAndDMALength = CHANNELS * (sizeof(sMDH) + samples.size() * sizeof(float));
+        mdh.ulScanCounter = n + 1;
+        mdh.ulTimeStamp = 4000000 + 4 * n;
+        mdh.ushSamplesInScan = SAMPLES;
+        mdh.ushUsedChannels = CHANNELS;
+        mdh.sLC.ushLine = (uint16_t) (n % 128);
+        mdh.sLC.ushRepetition = (uint16_t) (n / 128);
+        mdh.ushKSpaceCentreColumn = SAMPLES / 2;
+        mdh.sSliceData.aflQuaternion[0] = 1;
+
+        for (uint16_t c = 0; c < CHANNELS; c++) {
+            mdh.ushChannelId = c;
+            for (size_t k = 0; k < samples.size(); k++) {
+                samples[k] = (float) (n + c + k);
+            }
+            file.writeChannel(mdh, &samples[0]);
+        }
+    }
+}
+
+const unsigned long FAILED = (unsigned long) -1;
+
+// Converts the measurement like convertMeasurement, returns the allocations made during the second half
+static unsigned long convert(const ConversionSettings &settings, const std::string &output,
+                             const std::string &group)
+{
+    MeasurementReader reader(settings, 1);
+    reader.header();
+
+    size_t pool_size = size_t(settings.writer_queue_depth) + settings.writer_batch_size + 2;
+    boost::shared_ptr<AcquisitionPool> pool = boost::make_shared<AcquisitionPool>(pool_size);
+    reader.setAcquisitionPool(pool);
+
+    DatasetSink sink(BatchedDataset::create(output.c_str(), group.c_str()), settings.writer_queue_depth,
+                     settings.writer_batch_size, size_t(settings.writer_batch_mb) * 1024 * 1024, pool);
+    sink.writeHeader(reader.header());
+
+    MeasurementItem item;
+    unsigned int readouts = 0;
+    unsigned long steady_state_start = 0;
+    while (reader.next(item)) {
+        if (item.type == MeasurementItem::ACQUISITION) {
+            sink.appendAcquisition(std::move(item.acquisition));
+            if (++readouts == READOUTS / 2) {
+                steady_state_start = allocations.load();
+            }
+        } else {
+            sink.appendWaveform(std::move(item.waveform));
+        }
+    }
+    unsigned long steady_state = allocations.load() - steady_state_start;
+
+    sink.close();
+    sink.printStatistics(std::cout);
+    pool->printStatistics(std::cout);
+
+    if (readouts != READOUTS || !reader.good()) {
+        std::cout << "Converted " << readouts << " of " << READOUTS << " readouts" << std::endl;
+        return FAILED;
+    }
+    return steady_state;
+}
+
+int main()
+{
+    TemporaryDirectory dir("allocation_benchmark");
+    write_vb_file(dir.file("meas.dat"));
+    write_file(dir.file("parameter_map.xml"), parameter_map);
+    write_file(dir.file("parameter_map.xsl"), parameter_stylesheet);
+
+    ConversionSettings settings;
+    settings.siemens_dat_filename = dir.file("meas.dat");
+    settings.parammap_file = dir.file("parameter_map.xml");
+    settings.parammap_xsl = dir.file("parameter_map.xsl");
+    settings.skip_validation = true;
+    {
+        DatReader siemens_dat(settings.siemens_dat_filename);
+        if (!readFileLayout(siemens_dat, settings)) {
+            return 1;
+        }
+    }
+
+    unsigned long synchronous = FAILED;
+    unsigned long threaded = FAILED;
+    try {
+        settings.writer_queue_depth = 0;
+        synchronous = convert(settings, dir.file("out.h5"), "synchronous");
+        settings.writer_queue_depth = 256;
+        threaded = convert(settings, dir.file("out.h5"), "threaded");
+    }
+    catch (const std::exception &e) {
+        std::cout << e.what() << std::endl;
+    }
+
+    if (synchronous == FAILED || threaded == FAILED) {
+        return 1;
+    }
+
+    const unsigned int measured = READOUTS - READOUTS / 2;
+    std::cout << "Allocations in the last " << measured << " readouts: " << synchronous
+              << " with the writer on the calling thread (" << (double) synchronous / measured << " per readout), "
+              << threaded << " with the writer thread (" << (double) threaded / measured << " per readout)"
+              << std::endl;
+
+    return synchronous == 0 ? 0 : 1;
+}
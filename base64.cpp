@@ -1,5 +1,8 @@
 #include "base64.h"
-#include "sstream"
+#include "base64_dispatch.h"
+
+#include <stdint.h>
+#include <string.h>
 
 /*
    base64.cpp and base64.h
@@ -26,131 +29,342 @@
 
    René Nyffenegger rene.nyffenegger@adp-gmbh.ch
 
+   Altered for siemens_to_ismrmrd: table driven scalar code, SSSE3 and AVX2
+   versions of the encoder and decoder after Wojciech Muła's base64 work.
+
 */
 
-std::string base64_encode(unsigned char const* bytes_to_encode, unsigned int in_len)
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define BASE64_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+// Value of every base64 character, -1 for everything else (including '=')
+struct DecodeTable
 {
-    std::string ret;
-    int i = 0;
-    int j = 0;
-    unsigned char char_array_3[3];
-    unsigned char char_array_4[4];
+    signed char value[256];
 
-    while (in_len--)
+    DecodeTable()
     {
-        char_array_3[i++] = *(bytes_to_encode++);
-        if (i == 3)
-        {
-            char_array_4[0] = (char_array_3[0] & 0xfc) >> 2;
-            char_array_4[1] = ((char_array_3[0] & 0x03) << 4) + ((char_array_3[1] & 0xf0) >> 4);
-            char_array_4[2] = ((char_array_3[1] & 0x0f) << 2) + ((char_array_3[2] & 0xc0) >> 6);
-            char_array_4[3] = char_array_3[2] & 0x3f;
-
-            for(i = 0; (i <4) ; i++)
-                ret += base64_chars[char_array_4[i]];
-            i = 0;
+        memset(value, -1, sizeof(value));
+        for (int i = 0; i < 64; i++) {
+            value[(unsigned char) base64_chars[i]] = (signed char) i;
         }
     }
+};
 
-    if (i)
-    {
-        for(j = i; j < 3; j++)
-            char_array_3[j] = '\0';
+static const DecodeTable &decode_table()
+{
+    static const DecodeTable table;
+    return table;
+}
 
-        char_array_4[0] = (char_array_3[0] & 0xfc) >> 2;
-        char_array_4[1] = ((char_array_3[0] & 0x03) << 4) + ((char_array_3[1] & 0xf0) >> 4);
-        char_array_4[2] = ((char_array_3[1] & 0x0f) << 2) + ((char_array_3[2] & 0xc0) >> 6);
-        char_array_4[3] = char_array_3[2] & 0x3f;
+// Encodes len bytes (a multiple of 3) into 4 * len / 3 characters
+static void encode_scalar(const unsigned char *in, size_t len, char *out)
+{
+    for (size_t i = 0; i < len; i += 3) {
+        uint32_t v = ((uint32_t) in[i] << 16) | ((uint32_t) in[i + 1] << 8) | in[i + 2];
+        out[0] = base64_chars[v >> 18];
+        out[1] = base64_chars[(v >> 12) & 0x3f];
+        out[2] = base64_chars[(v >> 6) & 0x3f];
+        out[3] = base64_chars[v & 0x3f];
+        out += 4;
+    }
+}
 
-        for (j = 0; (j < i + 1); j++)
-            ret += base64_chars[char_array_4[j]];
+// Decodes in[0..len) up to the first character that is not base64. Returns the number of characters
+// used, which is a multiple of 4 unless the input ended or an invalid character was found; *written
+// is the number of bytes stored in out.
+static size_t decode_scalar(const unsigned char *in, size_t len, unsigned char *out, size_t *written)
+{
+    const signed char *table = decode_table().value;
+    uint32_t acc = 0;
+    size_t group = 0;
+    size_t i = 0;
+    unsigned char *o = out;
+    for (; i < len; i++) {
+        int v = table[in[i]];
+        if (v < 0) {
+            break;
+        }
+        acc = (acc << 6) | (uint32_t) v;
+        if (++group == 4) {
+            o[0] = (unsigned char) (acc >> 16);
+            o[1] = (unsigned char) (acc >> 8);
+            o[2] = (unsigned char) acc;
+            o += 3;
+            acc = 0;
+            group = 0;
+        }
+    }
 
-        while((i++ < 3))
-            ret += '=';
+    // Incomplete last group, the missing characters count as 'A'
+    if (group == 2) {
+        *o++ = (unsigned char) (acc >> 4);
+    } else if (group == 3) {
+        *o++ = (unsigned char) (acc >> 10);
+        *o++ = (unsigned char) (acc >> 2);
     }
-    return ret;
+
+    *written = o - out;
+    return i;
 }
 
+#ifdef BASE64_X86_DISPATCH
 
-std::string base64_decode(std::string const& encoded_string)
+// 16 base64 characters from the 6 bit values in the 16 bytes of indices
+__attribute__((target("ssse3")))
+static inline __m128i encode_lookup_ssse3(__m128i indices)
 {
-    int in_len = encoded_string.size();
-    int i = 0;
-    int j = 0;
-    int in_ = 0;
-    unsigned char char_array_4[4], char_array_3[3];
-    std::string ret;
-
-    while (in_len-- && ( encoded_string[in_] != '=') && is_base64(encoded_string[in_]))
-    {
-        char_array_4[i++] = encoded_string[in_]; in_++;
-        if (i ==4)
-        {
-            for (i = 0; i <4; i++)
-                char_array_4[i] = base64_chars.find(char_array_4[i]);
-
-              char_array_3[0] = (char_array_4[0] << 2) + ((char_array_4[1] & 0x30) >> 4);
-              char_array_3[1] = ((char_array_4[1] & 0xf) << 4) + ((char_array_4[2] & 0x3c) >> 2);
-              char_array_3[2] = ((char_array_4[2] & 0x3) << 6) + char_array_4[3];
-
-              for (i = 0; (i < 3); i++)
-                  ret += char_array_3[i];
-              i = 0;
-        }
-    }
+    const __m128i shift_lut = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                            '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                            '/' - 63, 'A', 0, 0);
+    // 0..51 -> 0, 52..61 -> 1..10, 62 -> 11, 63 -> 12, then 0..25 -> 13
+    __m128i result = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+    __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+    result = _mm_or_si128(result, _mm_and_si128(less, _mm_set1_epi8(13)));
+    return _mm_add_epi8(_mm_shuffle_epi8(shift_lut, result), indices);
+}
 
-    if (i)
-    {
-        for (j = i; j <4; j++)
-            char_array_4[j] = 0;
+// Splits 12 bytes (in 4 byte groups with the input bytes 1 2 0 1) into 16 values of 6 bits
+__attribute__((target("ssse3")))
+static inline __m128i encode_split_ssse3(__m128i in)
+{
+    in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+    __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+    __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+    __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+    __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+    return _mm_or_si128(t1, t3);
+}
 
-        for (j = 0; j <4; j++)
-            char_array_4[j] = base64_chars.find(char_array_4[j]);
+// Encodes 12 bytes per step while 16 can be loaded, returns the number of bytes encoded
+__attribute__((target("ssse3")))
+static size_t encode_ssse3(const unsigned char *in, size_t len, char *out)
+{
+    size_t i = 0;
+    for (; i + 16 <= len; i += 12) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (in + i));
+        _mm_storeu_si128((__m128i *) out, encode_lookup_ssse3(encode_split_ssse3(v)));
+        out += 16;
+    }
+    return i;
+}
 
-          char_array_3[0] = (char_array_4[0] << 2) + ((char_array_4[1] & 0x30) >> 4);
-          char_array_3[1] = ((char_array_4[1] & 0xf) << 4) + ((char_array_4[2] & 0x3c) >> 2);
-          char_array_3[2] = ((char_array_4[2] & 0x3) << 6) + char_array_4[3];
+__attribute__((target("avx2")))
+static size_t encode_avx2(const unsigned char *in, size_t len, char *out)
+{
+    const __m256i shuffle = _mm256_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1,
+                                            10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+    const __m256i shift_lut = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                               '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                               '/' - 63, 'A', 0, 0,
+                                               'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                               '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                               '/' - 63, 'A', 0, 0);
+    size_t i = 0;
+    // 24 bytes per step, 12 in each lane
+    for (; i + 28 <= len; i += 24) {
+        __m128i lo = _mm_loadu_si128((const __m128i *) (in + i));
+        __m128i hi = _mm_loadu_si128((const __m128i *) (in + i + 12));
+        __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+        v = _mm256_shuffle_epi8(v, shuffle);
+        __m256i t0 = _mm256_and_si256(v, _mm256_set1_epi32(0x0fc0fc00));
+        __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+        __m256i t2 = _mm256_and_si256(v, _mm256_set1_epi32(0x003f03f0));
+        __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+        __m256i indices = _mm256_or_si256(t1, t3);
+
+        __m256i result = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+        __m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+        result = _mm256_or_si256(result, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+        result = _mm256_add_epi8(_mm256_shuffle_epi8(shift_lut, result), indices);
+        _mm256_storeu_si256((__m256i *) out, result);
+        out += 32;
+    }
+    return i;
+}
 
-          for (j = 0; (j < i - 1); j++)
-              ret += char_array_3[j];
+// Decodes 16 characters per step into 12 bytes, stores 16. Stops before the first block that
+// has a character that is not base64 (or '='), returns the number of characters decoded.
+__attribute__((target("ssse3")))
+static size_t decode_ssse3(const unsigned char *in, size_t len, unsigned char *out)
+{
+    const __m128i shift_lut = _mm_setr_epi8(0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i mask_lut = _mm_setr_epi8((char) 0xa8, (char) 0xf8, (char) 0xf8, (char) 0xf8, (char) 0xf8,
+                                           (char) 0xf8, (char) 0xf8, (char) 0xf8, (char) 0xf8, (char) 0xf8,
+                                           (char) 0xf0, 0x54, 0x50, 0x50, 0x50, 0x54);
+    const __m128i bitpos_lut = _mm_setr_epi8(0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char) 0x80,
+                                             0, 0, 0, 0, 0, 0, 0, 0);
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (in + i));
+        __m128i higher_nibble = _mm_and_si128(_mm_srli_epi32(v, 4), _mm_set1_epi8(0x0f));
+        __m128i lower_nibble = _mm_and_si128(v, _mm_set1_epi8(0x0f));
+
+        // Valid characters have their bit set in the row of their lower nibble
+        __m128i m = _mm_shuffle_epi8(mask_lut, lower_nibble);
+        __m128i bit = _mm_shuffle_epi8(bitpos_lut, higher_nibble);
+        __m128i invalid = _mm_cmpeq_epi8(_mm_and_si128(m, bit), _mm_setzero_si128());
+        if (_mm_movemask_epi8(invalid)) {
+            break;
+        }
+
+        // Offset by the higher nibble, '/' shares it with '+' and is moved by 16 instead of 19
+        __m128i shift = _mm_shuffle_epi8(shift_lut, higher_nibble);
+        __m128i eq_2f = _mm_cmpeq_epi8(v, _mm_set1_epi8(0x2f));
+        shift = _mm_add_epi8(shift, _mm_and_si128(eq_2f, _mm_set1_epi8(-3)));
+        __m128i values = _mm_add_epi8(v, shift);
+
+        __m128i merged = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+        __m128i packed = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+        packed = _mm_shuffle_epi8(packed, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+        _mm_storeu_si128((__m128i *) out, packed);
+        out += 12;
     }
-    return ret;
+    return i;
 }
 
-void splitBigString(std::ofstream &resFile, std::string bigString, int parts)
+// 32 characters per step into 24 bytes, stores 32
+__attribute__((target("avx2")))
+static size_t decode_avx2(const unsigned char *in, size_t len, unsigned char *out)
 {
-  int len = bigString.length();
+    const __m256i shift_lut = _mm256_setr_epi8(0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+                                               0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i mask_lut = _mm256_setr_epi8((char) 0xa8, (char) 0xf8, (char) 0xf8, (char) 0xf8, (char) 0xf8,
+                                              (char) 0xf8, (char) 0xf8, (char) 0xf8, (char) 0xf8, (char) 0xf8,
+                                              (char) 0xf0, 0x54, 0x50, 0x50, 0x50, 0x54,
+                                              (char) 0xa8, (char) 0xf8, (char) 0xf8, (char) 0xf8, (char) 0xf8,
+                                              (char) 0xf8, (char) 0xf8, (char) 0xf8, (char) 0xf8, (char) 0xf8,
+                                              (char) 0xf0, 0x54, 0x50, 0x50, 0x50, 0x54);
+    const __m256i bitpos_lut = _mm256_setr_epi8(0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char) 0x80,
+                                                0, 0, 0, 0, 0, 0, 0, 0,
+                                                0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char) 0x80,
+                                                0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i pack_shuffle = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                                  2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *) (in + i));
+        __m256i higher_nibble = _mm256_and_si256(_mm256_srli_epi32(v, 4), _mm256_set1_epi8(0x0f));
+        __m256i lower_nibble = _mm256_and_si256(v, _mm256_set1_epi8(0x0f));
+
+        __m256i m = _mm256_shuffle_epi8(mask_lut, lower_nibble);
+        __m256i bit = _mm256_shuffle_epi8(bitpos_lut, higher_nibble);
+        __m256i invalid = _mm256_cmpeq_epi8(_mm256_and_si256(m, bit), _mm256_setzero_si256());
+        if (_mm256_movemask_epi8(invalid)) {
+            break;
+        }
+
+        __m256i shift = _mm256_shuffle_epi8(shift_lut, higher_nibble);
+        __m256i eq_2f = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(0x2f));
+        shift = _mm256_add_epi8(shift, _mm256_and_si256(eq_2f, _mm256_set1_epi8(-3)));
+        __m256i values = _mm256_add_epi8(v, shift);
+
+        __m256i merged = _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+        __m256i packed = _mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000));
+        packed = _mm256_shuffle_epi8(packed, pack_shuffle);
+        // 12 bytes at the start of each lane, moved together
+        packed = _mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+        _mm256_storeu_si256((__m256i *) out, packed);
+        out += 24;
+    }
+    return i;
+}
 
-  int at, pre=0, i;
+#endif //BASE64_X86_DISPATCH
 
-  int size_a_part = len/parts;
+#ifdef BASE64_INSTRUCTION_SET_LIMIT
+static Base64InstructionSet instruction_set_limit = BASE64_AVX2;
+#else
+static const Base64InstructionSet instruction_set_limit = BASE64_AVX2;
+#endif
 
-  if ( size_a_part == 0 )
-    {
-      resFile << "    v = \""<< bigString.substr(0, std::string::npos) << "\";" << std::endl;
+static bool use_avx2()
+{
+#ifdef BASE64_X86_DISPATCH
+    return instruction_set_limit >= BASE64_AVX2 && __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+
+static bool use_ssse3()
+{
+#ifdef BASE64_X86_DISPATCH
+    return instruction_set_limit >= BASE64_SSSE3 && __builtin_cpu_supports("ssse3");
+#else
+    return false;
+#endif
+}
+
+#ifdef BASE64_INSTRUCTION_SET_LIMIT
+Base64InstructionSet base64_limit_instruction_set(Base64InstructionSet isa)
+{
+    instruction_set_limit = isa;
+    if (use_avx2()) {
+        return BASE64_AVX2;
     }
-  else
-    {
-      for (pre = i = 0; i < parts-1; ++i)
-        {
-	  std::stringstream str;
-	  str << "    std::string v" << i << " = " << "\""<< bigString.substr(pre, size_a_part) << "\";" << std::endl;
-	  resFile << str.str();
-	  pre += size_a_part;
-        }
+    return use_ssse3() ? BASE64_SSSE3 : BASE64_SCALAR;
+}
+#endif
 
-      {
-	std::stringstream str;
-	str << "    std::string v" << parts-1 << " = " << "\""<< bigString.substr(pre, std::string::npos) << "\";" << std::endl;
-	resFile << str.str();
-      }
-
-      for (pre = i = 0; i < parts; ++i)
-        {
-	  std::stringstream str;
-	  str << "    v += v" << i << ";" << std::endl;
-	  resFile << str.str();
+std::string base64_encode(unsigned char const* bytes_to_encode, unsigned int in_len)
+{
+    size_t len = in_len;
+    size_t full = len - len % 3;
+    // Room for the 16/32 byte stores of the vector loops
+    std::string ret(4 * (len / 3 + 1) + 32, '\0');
+    char *out = &ret[0];
+
+    size_t done = 0;
+#ifdef BASE64_X86_DISPATCH
+    if (use_avx2()) {
+        done = encode_avx2(bytes_to_encode, full, out);
+    }
+    if (use_ssse3()) {
+        done += encode_ssse3(bytes_to_encode + done, full - done, out + done / 3 * 4);
+    }
+#endif
+    encode_scalar(bytes_to_encode + done, full - done, out + done / 3 * 4);
+    out += full / 3 * 4;
+
+    size_t rest = len - full;
+    if (rest) {
+        uint32_t v = (uint32_t) bytes_to_encode[full] << 16;
+        if (rest == 2) {
+            v |= (uint32_t) bytes_to_encode[full + 1] << 8;
         }
+        *out++ = base64_chars[v >> 18];
+        *out++ = base64_chars[(v >> 12) & 0x3f];
+        *out++ = rest == 2 ? base64_chars[(v >> 6) & 0x3f] : '=';
+        *out++ = '=';
     }
+
+    ret.resize(out - &ret[0]);
+    return ret;
 }
 
+
+std::string base64_decode(std::string const& encoded_string)
+{
+    const unsigned char *in = reinterpret_cast<const unsigned char *>(encoded_string.data());
+    size_t len = encoded_string.size();
+    std::string ret(len / 4 * 3 + 2 + 32, '\0');
+    unsigned char *out = reinterpret_cast<unsigned char *>(&ret[0]);
+
+    size_t done = 0;
+#ifdef BASE64_X86_DISPATCH
+    if (use_avx2()) {
+        done = decode_avx2(in, len, out);
+    }
+    if (use_ssse3()) {
+        done += decode_ssse3(in + done, len - done, out + done / 4 * 3);
+    }
+#endif
+    size_t written = 0;
+    decode_scalar(in + done, len - done, out + done / 4 * 3, &written);
+
+    ret.resize(done / 4 * 3 + written);
+    return ret;
+}
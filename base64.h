@@ -7,7 +7,7 @@
 #include <streambuf>
 
 
-static const std::string base64_chars =
+static const char base64_chars[] =
                "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
                "abcdefghijklmnopqrstuvwxyz"
                "0123456789+/";
@@ -18,9 +18,10 @@ static inline bool is_base64(unsigned char c)
     return (isalnum(c) || (c == '+') || (c == '/'));
 }
 
+// Both use SSSE3 or AVX2 when the CPU has them (x86 with GCC or clang), the result is the same
 std::string base64_encode(unsigned char const* bytes_to_encode, unsigned int in_len);
+// Decodes up to the first '=' or character that is not base64
 std::string base64_decode(std::string const& encoded_string);
-void splitBigString(std::ofstream &resFile, std::string bigString, int parts);
 
 #endif
 
@@ -0,0 +1,216 @@
+// Checks base64_encode() and base64_decode() against known answers and stored results of the previous
+// implementation, and times them. Every instruction set the CPU has (scalar, SSSE3, AVX2) is checked in turn:
+//  - the RFC 4648 test vectors, and how the decoder stops at '=' and characters that are not base64,
+//  - random inputs of 0 to 300 bytes and a few longer ones must decode back, the FNV-1a of their encodings
+//    must be the stored one,
+//  - encoded strings with a changed character (anything from '=' and the alphabet to bytes >= 0x80), cut at
+//    any length, with line breaks inside, and random garbage: the FNV-1a of what they decode to must be the
+//    stored one, which exercises the vector loops stopping in the middle of a block,
+//  - a 10 MB round trip must decode back and encode to the stored FNV-1a, its encode and decode are timed.
+// The inputs come from std::mt19937, whose output the standard fixes. Returns 1 if a result differs.
+
+#include "base64.h"
+#include "base64_dispatch.h"
+#include "benchmark_fixtures.h"
+
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// FNV-1a of the results of the previous implementation (the codec by René Nyffenegger that base64.cpp
+// started from), for the inputs generated below
+static const uint64_t random_encodings_hash = 0x7991d70549b9cd64ULL;
+static const uint64_t corrupted_decodings_hash = 0x1e2f7ab7a3f86a8eULL;
+static const uint64_t round_trip_encoding_hash = 0xb9e7f6d0de889478ULL;
+
+struct KnownAnswer
+{
+    const char *encoded;
+    const char *decoded;
+};
+
+// RFC 4648 section 10, each also decodes back
+static const KnownAnswer encodings[] = {
+    {"", ""},
+    {"Zg==", "f"},
+    {"Zm8=", "fo"},
+    {"Zm9v", "foo"},
+    {"Zm9vYg==", "foob"},
+    {"Zm9vYmE=", "fooba"},
+    {"Zm9vYmFy", "foobar"},
+};
+
+// The decoder stops at the first '=' or character that is not base64, an incomplete last group
+// gives the bytes that its characters complete
+static const KnownAnswer decodings[] = {
+    {"Zg", "f"},
+    {"Zm8", "fo"},
+    {"Z", ""},
+    {"Zm9vYmFy\nZm9v", "foobar"},
+    {"Zm=9v", "f"},
+    {"Zm9v!Zm9v", "foo"},
+    {"Zm9vYmFyZm9vYmFyZm9vYmFyZm9vYmFyZm9vYmFyZm9vYmFyZm9v-mFy", "foobarfoobarfoobarfoobarfoobarfoobarfoo"},
+};
+
+static const char *instruction_set_names[] = {"scalar", "SSSE3", "AVX2"};
+
+static std::string random_bytes(size_t len, std::mt19937 &rng)
+{
+    std::string s(len, '\0');
+    for (size_t i = 0; i < len; i++) {
+        s[i] = (char) rng();
+    }
+    return s;
+}
+
+static std::string encode(const std::string &s)
+{
+    return base64_encode(reinterpret_cast<const unsigned char *>(s.data()), (unsigned int) s.size());
+}
+
+// Hashes a result and its length, so that results can not run into each other
+static uint64_t hash_result(const std::string &s, uint64_t hash)
+{
+    return fnv1a(std::to_string(s.size()), fnv1a(s, hash));
+}
+
+static bool check_known_answers()
+{
+    bool ok = true;
+    for (size_t i = 0; i < sizeof(encodings) / sizeof(encodings[0]); i++) {
+        if (encode(encodings[i].decoded) != encodings[i].encoded ||
+            base64_decode(encodings[i].encoded) != encodings[i].decoded) {
+            std::cout << "  \"" << encodings[i].decoded << "\" does not encode to " << encodings[i].encoded
+                      << " and back" << std::endl;
+            ok = false;
+        }
+    }
+    for (size_t i = 0; i < sizeof(decodings) / sizeof(decodings[0]); i++) {
+        if (base64_decode(decodings[i].encoded) != decodings[i].decoded) {
+            std::cout << "  " << decodings[i].encoded << " does not decode to \"" << decodings[i].decoded << "\""
+                      << std::endl;
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+static bool check_random(std::mt19937 &rng)
+{
+    std::vector<size_t> lengths;
+    for (size_t len = 0; len <= 300; len++) {
+        lengths.push_back(len);
+    }
+    lengths.push_back(4095);
+    lengths.push_back(4096);
+    lengths.push_back(65537);
+
+    bool ok = true;
+    uint64_t hash = fnv1a("");
+    for (size_t l = 0; l < lengths.size(); l++) {
+        std::string data = random_bytes(lengths[l], rng);
+        std::string encoded = encode(data);
+        if (ok && base64_decode(encoded) != data) {
+            std::cout << "  " << data.size() << " bytes do not decode back" << std::endl;
+            ok = false;
+        }
+        hash = hash_result(encoded, hash);
+    }
+    if (hash != random_encodings_hash) {
+        std::cout << "  encodings of random inputs differ" << std::endl;
+        ok = false;
+    }
+    return ok;
+}
+
+static bool check_corrupted(std::mt19937 &rng)
+{
+    uint64_t hash = fnv1a("");
+    for (int n = 0; n < 2000; n++) {
+        std::string encoded = encode(random_bytes(rng() % 200, rng));
+        if (encoded.empty()) {
+            continue;
+        }
+
+        std::string changed = encoded;
+        size_t at = rng() % changed.size();
+        switch (rng() % 4) {
+        case 0: changed[at] = (char) rng(); break;
+        case 1: changed[at] = '='; break;
+        case 2: changed[at] = "\n\r -_.*"[rng() % 7]; break;
+        default: changed[at] = (char) (0x80 | rng()); break;
+        }
+        hash = hash_result(base64_decode(changed), hash);
+
+        hash = hash_result(base64_decode(encoded.substr(0, rng() % (encoded.size() + 1))), hash);
+
+        std::string wrapped = encoded;
+        for (size_t i = 76; i < wrapped.size(); i += 77) {
+            wrapped.insert(i, 1, '\n');
+        }
+        hash = hash_result(base64_decode(wrapped), hash);
+
+        hash = hash_result(base64_decode(random_bytes(rng() % 200, rng)), hash);
+    }
+    if (hash != corrupted_decodings_hash) {
+        std::cout << "  decodings of corrupted inputs differ" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main()
+{
+    const size_t round_trip_bytes = 10 * 1024 * 1024;
+
+    std::mt19937 rng(2024);
+    std::string data = random_bytes(round_trip_bytes, rng);
+
+    std::cout << std::fixed << std::setprecision(4);
+
+    bool ok = true;
+    double scalar_encode_time = 0, scalar_decode_time = 0;
+    const Base64InstructionSet instruction_sets[] = {BASE64_SCALAR, BASE64_SSSE3, BASE64_AVX2};
+    for (size_t i = 0; i < sizeof(instruction_sets) / sizeof(instruction_sets[0]); i++) {
+        if (base64_limit_instruction_set(instruction_sets[i]) != instruction_sets[i]) {
+            std::cout << instruction_set_names[instruction_sets[i]] << ": not supported by this CPU" << std::endl;
+            continue;
+        }
+
+        bool path_ok = check_known_answers();
+        std::mt19937 path_rng(2025);
+        path_ok = check_random(path_rng) && path_ok;
+        path_ok = check_corrupted(path_rng) && path_ok;
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        std::string encoded = encode(data);
+        double encode_time = seconds_since(start);
+        start = std::chrono::steady_clock::now();
+        std::string decoded = base64_decode(encoded);
+        double decode_time = seconds_since(start);
+        if (fnv1a(encoded) != round_trip_encoding_hash || decoded != data) {
+            std::cout << "  10 MB round trip differs" << std::endl;
+            path_ok = false;
+        }
+        if (instruction_sets[i] == BASE64_SCALAR) {
+            scalar_encode_time = encode_time;
+            scalar_decode_time = decode_time;
+        }
+
+        std::cout << instruction_set_names[instruction_sets[i]] << ": 10 MB encode " << encode_time << " s";
+        if (instruction_sets[i] != BASE64_SCALAR) {
+            std::cout << " (speedup " << scalar_encode_time / encode_time << ")";
+        }
+        std::cout << ", decode " << decode_time << " s";
+        if (instruction_sets[i] != BASE64_SCALAR) {
+            std::cout << " (speedup " << scalar_decode_time / decode_time << ")";
+        }
+        std::cout << ", " << (path_ok ? "identical" : "differs") << std::endl;
+        ok = ok && path_ok;
+    }
+    base64_limit_instruction_set(BASE64_AVX2);
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,12 @@
+#ifndef base64_dispatch_h
+#define base64_dispatch_h
+
+enum Base64InstructionSet { BASE64_SCALAR, BASE64_SSSE3, BASE64_AVX2 };
+
+// Restricts base64_encode and base64_decode to isa and below, for base64_benchmark to check every path.
+// Returns the instruction set they use from then on, lower than isa if the CPU does not have it.
+// Only defined when base64.cpp is built with BASE64_INSTRUCTION_SET_LIMIT (not thread safe), the
+// library always uses the best instruction set of the CPU.
+Base64InstructionSet base64_limit_instruction_set(Base64InstructionSet isa);
+
+#endif
@@ -0,0 +1,123 @@
+// Writes the same acquisitions once with a batch size of 1 (ISMRMRD::Dataset::appendAcquisition, what --batchSize 1
+// does) and once in batches (BatchedDataset::appendAcquisitions) into two groups of a temporary file, prints both
+// timings and reads both groups back. Returns 1 if the datasets differ: the number of acquisitions, the headers and
+// the data and trajectory samples of every acquisition must be identical.
+
+#include "BatchedDataset.h"
+#include "DatasetWriter.h"
+#include "benchmark_fixtures.h"
+
+#include "ismrmrd/ismrmrd.h"
+#include "ismrmrd/dataset.h"
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+// Acquisition i of the benchmark, every 16th one with a 2D trajectory
+static void fill_acquisition(unsigned int i, ISMRMRD::Acquisition &acq)
+{
+    const uint16_t samples = 128;
+    const uint16_t channels = 4;
+    acq.resize(samples, channels, i % 16 == 0 ? 2 : 0);
+    acq.clearAllFlags();
+
+    acq.scan_counter() = i;
+    acq.acquisition_time_stamp() = 1000 + 4 * i;
+    acq.idx().kspace_encode_step_1 = (uint16_t) (i % 128);
+    acq.idx().slice = (uint16_t) (i / 128 % 3);
+    acq.idx().repetition = (uint16_t) (i / 384);
+    acq.center_sample() = samples / 2;
+    acq.sample_time_us() = 2.5f;
+    acq.read_dir()[0] = 1;
+    acq.phase_dir()[1] = 1;
+    acq.slice_dir()[2] = 1;
+    if (i % 128 == 127) {
+        acq.setFlag(ISMRMRD::ISMRMRD_ACQ_LAST_IN_SLICE);
+    }
+
+    complex_float_t *data = acq.getDataPtr();
+    for (size_t k = 0; k < acq.getNumberOfDataElements(); k++) {
+        data[k] = complex_float_t((float) (i + k), (float) i - (float) k);
+    }
+    float *traj = acq.getTrajPtr();
+    for (size_t k = 0; k < acq.getNumberOfTrajElements(); k++) {
+        traj[k] = (float) k / samples - 0.5f;
+    }
+}
+
+// Time to write acquisitions acquisitions into group through a DatasetWriter, including closing the dataset
+static double write_group(const std::string &filename, const std::string &group, unsigned int acquisitions,
+                          size_t batch_size)
+{
+    std::vector<std::unique_ptr<ISMRMRD::Acquisition> > acqs(acquisitions);
+    for (unsigned int i = 0; i < acquisitions; i++) {
+        acqs[i].reset(new ISMRMRD::Acquisition());
+        fill_acquisition(i, *acqs[i]);
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    {
+        boost::shared_ptr<BatchedDataset> dataset = BatchedDataset::create(filename.c_str(), group.c_str());
+        DatasetWriter writer(dataset, 0, batch_size, 16 * 1024 * 1024);
+        for (unsigned int i = 0; i < acquisitions; i++) {
+            writer.appendAcquisition(std::move(acqs[i]));
+        }
+        writer.close();
+    }
+    return seconds_since(start);
+}
+
+static bool same_acquisition(const ISMRMRD::Acquisition &a, const ISMRMRD::Acquisition &b)
+{
+    return memcmp(&a.getHead(), &b.getHead(), sizeof(ISMRMRD::ISMRMRD_AcquisitionHeader)) == 0 &&
+           a.getNumberOfDataElements() == b.getNumberOfDataElements() &&
+           a.getNumberOfTrajElements() == b.getNumberOfTrajElements() &&
+           memcmp(a.getDataPtr(), b.getDataPtr(), a.getDataSize()) == 0 &&
+           memcmp(a.getTrajPtr(), b.getTrajPtr(), a.getTrajSize()) == 0;
+}
+
+// Reads group back and compares it with the acquisitions that were written
+static bool check_group(const std::string &filename, const std::string &group, unsigned int acquisitions)
+{
+    ISMRMRD::Dataset dataset(filename.c_str(), group.c_str(), false);
+    if (dataset.getNumberOfAcquisitions() != acquisitions) {
+        std::cout << group << ": " << dataset.getNumberOfAcquisitions() << " acquisitions, expected " << acquisitions
+                  << std::endl;
+        return false;
+    }
+
+    ISMRMRD::Acquisition expected, acq;
+    for (unsigned int i = 0; i < acquisitions; i++) {
+        fill_acquisition(i, expected);
+        dataset.readAcquisition(i, acq);
+        if (!same_acquisition(expected, acq)) {
+            std::cout << group << ": acquisition " << i << " differs" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+int main()
+{
+    const unsigned int acquisitions = 10000;
+    const size_t batch_size = 64;
+
+    TemporaryDirectory dir("batched_dataset");
+    std::string file = dir.file("batched_dataset.h5");
+
+    double single_time = write_group(file, "batch_size_1", acquisitions, 1);
+    double batched_time = write_group(file, "batched", acquisitions, batch_size);
+
+    std::cout << acquisitions << " acquisitions: batch size 1 " << single_time << " s, batch size " << batch_size
+              << " " << batched_time << " s, speedup " << single_time / batched_time << std::endl;
+
+    bool ok = check_group(file, "batch_size_1", acquisitions);
+    ok = check_group(file, "batched", acquisitions) && ok;
+
+    std::cout << (ok ? "Datasets are identical" : "Datasets differ") << std::endl;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,67 @@
+#include "benchmark_fixtures.h"
+
+#include <cstring>
+
+double seconds_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+uint64_t fnv1a(const std::string &s, uint64_t hash)
+{
+    for (size_t i = 0; i < s.size(); i++) {
+        hash = (hash ^ (unsigned char) s[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+TemporaryDirectory::TemporaryDirectory(const std::string &prefix)
+    : path_(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path(prefix + "_%%%%-%%%%"))
+{
+    boost::filesystem::create_directories(path_);
+}
+
+TemporaryDirectory::~TemporaryDirectory()
+{
+    boost::system::error_code ec;
+    boost::filesystem::remove_all(path_, ec);
+}
+
+template <typename T> static void write(std::ofstream &f, const T &value)
+{
+    f.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+SyntheticVBFile::SyntheticVBFile(const std::string &filename, const std::string &buffer_name,
+                                 const std::string &buffer)
+    : file_(filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc)
+{
+    std::string contents = buffer + std::string(2, '\0');
+
+    // Header length, number of buffers, the buffer, padded to a 32 byte boundary
+    uint32_t header_length = 2 * sizeof(uint32_t) + buffer_name.size() + 1 + sizeof(uint32_t) + contents.size();
+    header_length = (header_length + 31) / 32 * 32;
+
+    write(file_, header_length);
+    write(file_, (uint32_t) 1);
+    file_.write(buffer_name.c_str(), buffer_name.size() + 1);
+    write(file_, (uint32_t) contents.size());
+    file_.write(contents.data(), contents.size());
+    while ((uint32_t) file_.tellp() < header_length) {
+        file_.put('\0');
+    }
+}
+
+void SyntheticVBFile::writeChannel(const sMDH &mdh, const float *samples)
+{
+    write(file_, mdh);
+    file_.write(reinterpret_cast<const char *>(samples), 2 * mdh.ushSamplesInScan * sizeof(float));
+}
+
+void SyntheticVBFile::writeAcqEnd()
+{
+    sMDH acqend;
+    memset(&acqend, 0, sizeof(acqend));
+    acqend.aulEvalInfoMask[0] = 1;
+    write(file_, acqend);
+}
@@ -0,0 +1,56 @@
+#ifndef BENCHMARK_FIXTURES_H_
+#define BENCHMARK_FIXTURES_H_
+
+#include "siemensraw.h"
+
+#include <boost/filesystem.hpp>
+
+#include <chrono>
+#include <fstream>
+#include <string>
+
+// Shared by the checks and benchmarks next to the library (*_check.cpp, *_benchmark.cpp), not installed
+
+double seconds_since(std::chrono::steady_clock::time_point start);
+
+/// FNV-1a of s, continued from hash. Stable across compilers and runs, for checks against stored results.
+uint64_t fnv1a(const std::string &s, uint64_t hash = 14695981039346656037ULL);
+
+/// Directory with a unique name in the temp directory, removed with everything in it by the destructor
+class TemporaryDirectory
+{
+public:
+    explicit TemporaryDirectory(const std::string &prefix);
+    ~TemporaryDirectory();
+
+    const boost::filesystem::path &path() const { return path_; }
+
+    /// Path of name in the directory
+    std::string file(const std::string &name) const { return (path_ / name).string(); }
+
+private:
+    TemporaryDirectory(const TemporaryDirectory &);
+    TemporaryDirectory &operator=(const TemporaryDirectory &);
+
+    boost::filesystem::path path_;
+};
+
+/// Writes a synthetic VB .dat file: a measurement header with a single buffer, then the scans with one
+/// sMDH and the samples for every channel.
+class SyntheticVBFile
+{
+public:
+    /// The buffer is followed by the two characters that the readers drop from every buffer
+    SyntheticVBFile(const std::string &filename, const std::string &buffer_name, const std::string &buffer);
+
+    /// One channel of a scan, samples has 2 * mdh.ushSamplesInScan floats
+    void writeChannel(const sMDH &mdh, const float *samples);
+
+    /// ACQEND scan, without it the measurement ends at the end of the file
+    void writeAcqEnd();
+
+private:
+    std::ofstream file_;
+};
+
+#endif //BENCHMARK_FIXTURES_H_
@@ -1,6 +1,14 @@
-#include "base64.h"
 #include "boost/filesystem.hpp"
 
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Writes the files as byte arrays and a table sorted by file name (see EmbeddedFiles.h).
+// Byte arrays rather than string literals, which compilers limit in length.
 int main(int argc, char *argv[])
 {
   if (argc < 3) {
@@ -8,36 +16,57 @@ int main(int argc, char *argv[])
     return 1;
   }
 
-  char *outfile_name = argv[argc - 1];
-  std::ofstream output(outfile_name, std::ofstream::out);
-  output << "#include <iostream>" << std::endl;
-  output << "#include <map>" << std::endl << std::endl;
-  output << "#include <string>" << std::endl << std::endl;
-
-  std::string map_name = "global_embedded_files";
-  output << "std::map<std::string, std::string> "<< map_name << ";" << std::endl << std::endl;
-
-  output << "void initializeEmbeddedFiles(void) {" << std::endl;
-
+  std::vector<std::pair<std::string, std::string> > files;
   for (int i = 1; i < argc - 1; i++) {
     char *infile_name = argv[i];
-    std::ifstream infile(infile_name);
+    std::ifstream infile(infile_name, std::ifstream::in | std::ifstream::binary);
+    if (!infile) {
+      std::cerr << "Failed to open " << infile_name << std::endl;
+      return 1;
+    }
     std::string contents((std::istreambuf_iterator<char>)(infile), std::istreambuf_iterator<char>());
 
-    std::string encoded = base64_encode(reinterpret_cast<const unsigned char*>(contents.c_str()), contents.length());
-
     boost::filesystem::path path(infile_name);
-    std::string keyname = path.filename().string();
-    output << "{" << std::endl;
-    output << "    std::string v; " << std::endl;
-    splitBigString(output, encoded, 12);
-    output << map_name << "[\"" << keyname << "\"] = v;" << std::endl;
-    output << "}" << std::endl;
+    files.push_back(std::make_pair(path.filename().string(), contents));
   }
+  std::sort(files.begin(), files.end());
 
-  output << "}" << std::endl;
+  char *outfile_name = argv[argc - 1];
+  std::ofstream output(outfile_name, std::ofstream::out);
+  output << "// Generated by embed, do not edit" << std::endl;
+  output << "#include \"EmbeddedFiles.h\"" << std::endl << std::endl;
+
+  for (size_t f = 0; f < files.size(); f++) {
+    const std::string &contents = files[f].second;
+    output << "static const char embedded_file_" << f << "[] = {";
+    for (size_t i = 0; i < contents.size(); i++) {
+      if (i % 24 == 0) {
+        output << std::endl << "   ";
+      }
+      // Bytes above 127 as casts, char may be signed or unsigned
+      unsigned int byte = (unsigned char) contents[i];
+      if (byte < 128) {
+        output << " " << byte << ",";
+      } else {
+        output << " (char) " << byte << ",";
+      }
+    }
+    output << std::endl << "    0" << std::endl << "};" << std::endl << std::endl;
+  }
+
+  output << "extern const EmbeddedFile embedded_files[] = {" << std::endl;
+  for (size_t f = 0; f < files.size(); f++) {
+    output << "    {\"" << files[f].first << "\", embedded_file_" << f << ", " << files[f].second.size() << "},"
+           << std::endl;
+  }
+  output << "};" << std::endl << std::endl;
+  output << "extern const size_t embedded_file_count = " << files.size() << ";" << std::endl;
 
   output.close();
+  if (!output) {
+    std::cerr << "Failed to write " << outfile_name << std::endl;
+    return 1;
+  }
 
   return 0;
 }
@@ -5,22 +5,73 @@
 #include <sstream>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
 
 #define SET_MIN(A,B) A = B < A ? B : A
 #define SET_MAX(A,B) A = B > A ? B : A
 
+static_assert(sizeof(mdhLC) == MDH_NUMBEROFLOOPCOUNTERS * sizeof(uint16_t), "mdhLC must be an array of the loop counters");
+
+// Smallest and largest of n values, eight at a time
+static void min_max_u16(const uint16_t* v, size_t n, uint16_t& min, uint16_t& max)
+{
+	uint16_t lo = 0xFFFF;
+	uint16_t hi = 0;
+	size_t i = 0;
+#ifdef __SSE2__
+	if (n >= 8) {
+		// SSE2 only has signed 16 bit min/max, flipping the top bit maps the unsigned order onto the signed one
+		const __m128i bias = _mm_set1_epi16((short)0x8000);
+		__m128i vmin = _mm_set1_epi16(0x7FFF);
+		__m128i vmax = _mm_set1_epi16((short)0x8000);
+		for (; i + 8 <= n; i += 8) {
+			__m128i x = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(v + i)), bias);
+			vmin = _mm_min_epi16(vmin, x);
+			vmax = _mm_max_epi16(vmax, x);
+		}
+		uint16_t lanes_min[8], lanes_max[8];
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(lanes_min), _mm_xor_si128(vmin, bias));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(lanes_max), _mm_xor_si128(vmax, bias));
+		for (int k = 0; k < 8; k++) {
+			SET_MIN(lo, lanes_min[k]);
+			SET_MAX(hi, lanes_max[k]);
+		}
+	}
+#elif defined(__aarch64__)
+	if (n >= 8) {
+		uint16x8_t vmin = vdupq_n_u16(0xFFFF);
+		uint16x8_t vmax = vdupq_n_u16(0);
+		for (; i + 8 <= n; i += 8) {
+			uint16x8_t x = vld1q_u16(v + i);
+			vmin = vminq_u16(vmin, x);
+			vmax = vmaxq_u16(vmax, x);
+		}
+		lo = vminvq_u16(vmin);
+		hi = vmaxvq_u16(vmax);
+	}
+#endif
+	for (; i < n; i++) {
+		SET_MIN(lo, v[i]);
+		SET_MAX(hi, v[i]);
+	}
+	min = lo;
+	max = hi;
+}
+
 SiemensRawData::SiemensRawData()
-:m_first_node         (NULL),
- m_last_node          (NULL),
- m_number_of_nodes    (0),
- m_min_max_is_valid   (false)
+:m_min_max_is_valid   (false)
 {
 
 }
 
 SiemensRawData::~SiemensRawData()
 {
-	DeleteNodeList();
 }
 
 int SiemensRawData::ReadRawFile(char* filename)
@@ -65,6 +116,11 @@ int SiemensRawData::ReadRawFile(char* filename)
 
 	f.seekg(header_length, std::ios_base::beg);
 
+	//The samples can not take more than the rest of the file, so the arena is allocated once
+	if (file_length > header_length) {
+		m_data.reserve((file_length - header_length) / sizeof(float));
+	}
+
 	while (ReadMdhNode(&f) > 0 && ((file_length-f.tellg())>(unsigned int)sizeof(sMDH)))
 	{
 		//...
@@ -74,99 +130,53 @@ int SiemensRawData::ReadRawFile(char* filename)
 
 	UpdateMinMax();
 
-	//std::cout << "Done reading. Total mdh count: " << m_number_of_nodes << std::endl;
+	//std::cout << "Done reading. Total mdh count: " << m_mdh.size() << std::endl;
 	ParseMeasYaps();
-	return m_number_of_nodes;
+	return m_mdh.size();
 }
 
 int SiemensRawData::ReadMdhNode(std::ifstream* f)
 {
-	SiemensMdhNode* new_node = NULL;
-
 	if (f->eof())
 	{
 		return -1;
 	}
 
-	try {
-		new_node = new SiemensMdhNode;
-	} catch (...) {
-		std::cout << "SiemensRawData::ReadMdhNode: Failed to allocate new node" << std::endl;
-		return -1;
-	}
-
-	new_node->data = NULL;
-	new_node->previous = NULL;
-	new_node->next = NULL;
-
-	try
-	{
-		f->read(reinterpret_cast<char*>(&(new_node->mdh)),sizeof(sMDH));
-	} catch (...) {
+	sMDH mdh;
+	if (!f->read(reinterpret_cast<char*>(&mdh),sizeof(sMDH))) {
 		std::cout << "SiemensRawData::ReadMdhNode: Unable to read mdh" << std::endl;
-		delete new_node;
 		return -1;
 	}
 
 	//Is this end of acquisition
-	if (new_node->mdh.aulEvalInfoMask[0] & 0x0001)
+	if (mdh.aulEvalInfoMask[0] & 0x0001)
 	{
-		delete new_node;
 		return -1;
 	}
 
+	size_t offset = m_data.size();
+	size_t length = mdh.ushSamplesInScan * 2;
 	try
 	{
-		new_node->data = new float[new_node->mdh.ushSamplesInScan * 2];
+		m_data.resize(offset + length);
 	} catch (...) {
-		std::cout << "SiemensRawData::ReadMdhNode: Unable to allocate memory in data node" << std::endl;
-		delete new_node;
+		std::cout << "SiemensRawData::ReadMdhNode: Unable to allocate memory for the data" << std::endl;
 		return -1;
 	}
 
-	try
-	{
-		f->read(reinterpret_cast<char*>(new_node->data),sizeof(float)*new_node->mdh.ushSamplesInScan*2);
-	} catch (...) {
+	if (!f->read(reinterpret_cast<char*>(&m_data[offset]),sizeof(float)*length)) {
 		std::cout << "SiemensRawData::ReadMdhNode: Unable to read data for data node" << std::endl;
-		delete [] new_node->data;
-		delete new_node;
+		m_data.resize(offset);
 		return -1;
 	}
 
-	if (m_first_node == NULL) m_first_node = new_node;
-	if (m_last_node == NULL)
-	{
-		m_last_node = new_node;
-		m_last_node->previous = NULL;
-		m_last_node->next = NULL;
-	}
-	else
-	{
-		m_last_node->next = new_node;
-		new_node->previous = m_last_node;
-		m_last_node = new_node;
-	}
-	m_number_of_nodes++;
-
-	m_min_max_is_valid = false;
-
-	return 1;
-}
-
-int SiemensRawData::DeleteNode(SiemensMdhNode* node)
-{
-	if (node)
-	{
-		SiemensMdhNode* prev = (SiemensMdhNode*)node->previous;
-		SiemensMdhNode* next = (SiemensMdhNode*)node->next;
-
-		if (node->data) delete [] node->data;
-		delete node;
-
-		if (prev) prev->next = next;
-		if (next) next->previous = prev;
+	m_mdh.push_back(mdh);
+	m_data_offset.push_back(offset);
 
+	uint16_t lc[MDH_NUMBEROFLOOPCOUNTERS];
+	memcpy(lc, &mdh.sLC, sizeof(lc));
+	for (int i = 0; i < MDH_NUMBEROFLOOPCOUNTERS; i++) {
+		m_lc[i].push_back(lc[i]);
 	}
 
 	m_min_max_is_valid = false;
@@ -174,93 +184,80 @@ int SiemensRawData::DeleteNode(SiemensMdhNode* node)
 	return 1;
 }
 
-int SiemensRawData::DeleteNodeList()
-{
-	SiemensMdhNode* next;
-	while(m_first_node)
-	{
-		next = (SiemensMdhNode*)m_first_node->next;
-		DeleteNode(m_first_node);
-		m_first_node = next;
-	}
-
-	return 1;
-}
-
 int SiemensRawData::UpdateMinMax()
 {
-	SiemensMdhNode* next = m_first_node;
-
-	m_mdh_min = next->mdh;
-	m_mdh_max = next->mdh;
+	if (m_mdh.empty()) {
+		memset(&m_mdh_min, 0, sizeof(sMDH));
+		memset(&m_mdh_max, 0, sizeof(sMDH));
+		for (int c = 0; c < MDH_NUMBEROFLOOPCOUNTERS; c++) {
+			m_lc_histogram[c].clear();
+		}
+		m_min_max_is_valid = true;
+		return 1;
+	}
 
-	while (next)
+	//One pass over the contiguous headers. The extremes are kept in locals, which the compiler can hold in
+	//registers, and SET_MIN/SET_MAX compile to branch free min/max.
+	sMDH mdh_min = m_mdh[0];
+	sMDH mdh_max = m_mdh[0];
+	const sMDH* mdh = &m_mdh[0];
+	const size_t count = m_mdh.size();
+	for (size_t n = 0; n < count; n++)
 	{
-		SET_MIN(m_mdh_min.ulScanCounter,         next->mdh.ulScanCounter);
-		SET_MAX(m_mdh_max.ulScanCounter,         next->mdh.ulScanCounter);
-		SET_MIN(m_mdh_min.ulTimeStamp,           next->mdh.ulTimeStamp);
-		SET_MAX(m_mdh_max.ulTimeStamp,           next->mdh.ulTimeStamp);
-		SET_MIN(m_mdh_min.ulPMUTimeStamp,        next->mdh.ulPMUTimeStamp);
-		SET_MAX(m_mdh_max.ulPMUTimeStamp,        next->mdh.ulPMUTimeStamp);
-		SET_MIN(m_mdh_min.ushSamplesInScan,      next->mdh.ushSamplesInScan);
-		SET_MAX(m_mdh_max.ushSamplesInScan,      next->mdh.ushSamplesInScan);
-		SET_MIN(m_mdh_min.ushUsedChannels,       next->mdh.ushUsedChannels);
-		SET_MAX(m_mdh_max.ushUsedChannels,       next->mdh.ushUsedChannels);
-		SET_MIN(m_mdh_min.sLC.ushLine,           next->mdh.sLC.ushLine);
-		SET_MAX(m_mdh_max.sLC.ushLine,           next->mdh.sLC.ushLine);
-		SET_MIN(m_mdh_min.sLC.ushAcquisition,    next->mdh.sLC.ushAcquisition);
-		SET_MAX(m_mdh_max.sLC.ushAcquisition,    next->mdh.sLC.ushAcquisition);
-		SET_MIN(m_mdh_min.sLC.ushSlice,          next->mdh.sLC.ushSlice);
-		SET_MAX(m_mdh_max.sLC.ushSlice,          next->mdh.sLC.ushSlice);
-		SET_MIN(m_mdh_min.sLC.ushPartition,      next->mdh.sLC.ushPartition);
-		SET_MAX(m_mdh_max.sLC.ushPartition,      next->mdh.sLC.ushPartition);
-		SET_MIN(m_mdh_min.sLC.ushEcho,           next->mdh.sLC.ushEcho);
-		SET_MAX(m_mdh_max.sLC.ushEcho,           next->mdh.sLC.ushEcho);
-		SET_MIN(m_mdh_min.sLC.ushPhase,          next->mdh.sLC.ushPhase);
-		SET_MAX(m_mdh_max.sLC.ushPhase,          next->mdh.sLC.ushPhase);
-		SET_MIN(m_mdh_min.sLC.ushRepetition,     next->mdh.sLC.ushRepetition);
-		SET_MAX(m_mdh_max.sLC.ushRepetition,     next->mdh.sLC.ushRepetition);
-		SET_MIN(m_mdh_min.sLC.ushSet,            next->mdh.sLC.ushSet);
-		SET_MAX(m_mdh_max.sLC.ushSet,            next->mdh.sLC.ushSet);
-		SET_MIN(m_mdh_min.sLC.ushSeg,            next->mdh.sLC.ushSeg);
-		SET_MAX(m_mdh_max.sLC.ushSeg,            next->mdh.sLC.ushSeg);
-		SET_MIN(m_mdh_min.sLC.ushIda,            next->mdh.sLC.ushIda);
-		SET_MAX(m_mdh_max.sLC.ushIda,            next->mdh.sLC.ushIda);
-		SET_MIN(m_mdh_min.sLC.ushIdb,            next->mdh.sLC.ushIdb);
-		SET_MAX(m_mdh_max.sLC.ushIdb,            next->mdh.sLC.ushIdb);
-		SET_MIN(m_mdh_min.sLC.ushIdc,            next->mdh.sLC.ushIdc);
-		SET_MAX(m_mdh_max.sLC.ushIdc,            next->mdh.sLC.ushIdc);
-		SET_MIN(m_mdh_min.sLC.ushIdd,            next->mdh.sLC.ushIdd);
-		SET_MAX(m_mdh_max.sLC.ushIdd,            next->mdh.sLC.ushIdd);
-		SET_MIN(m_mdh_min.sLC.ushIde,            next->mdh.sLC.ushIde);
-		SET_MAX(m_mdh_max.sLC.ushIde,            next->mdh.sLC.ushIde);
-		SET_MIN(m_mdh_min.ushKSpaceCentreColumn, next->mdh.ushKSpaceCentreColumn);
-		SET_MAX(m_mdh_max.ushKSpaceCentreColumn, next->mdh.ushKSpaceCentreColumn);
-		SET_MIN(m_mdh_min.ushCoilSelect,         next->mdh.ushCoilSelect);
-		SET_MAX(m_mdh_max.ushCoilSelect,         next->mdh.ushCoilSelect);
-		SET_MIN(m_mdh_min.fReadOutOffcentre,     next->mdh.fReadOutOffcentre);
-		SET_MAX(m_mdh_max.fReadOutOffcentre,     next->mdh.fReadOutOffcentre);
-		SET_MIN(m_mdh_min.ulTimeSinceLastRF,     next->mdh.ulTimeSinceLastRF);
-		SET_MAX(m_mdh_max.ulTimeSinceLastRF,     next->mdh.ulTimeSinceLastRF);
-		SET_MIN(m_mdh_min.ushKSpaceCentreLineNo, next->mdh.ushKSpaceCentreLineNo);
-		SET_MAX(m_mdh_max.ushKSpaceCentreLineNo, next->mdh.ushKSpaceCentreLineNo);
-		SET_MIN(m_mdh_min.ushKSpaceCentrePartitionNo, next->mdh.ushKSpaceCentrePartitionNo);
-		SET_MAX(m_mdh_max.ushKSpaceCentrePartitionNo, next->mdh.ushKSpaceCentrePartitionNo);
+		const sMDH& cur = mdh[n];
+		SET_MIN(mdh_min.ulScanCounter,         cur.ulScanCounter);
+		SET_MAX(mdh_max.ulScanCounter,         cur.ulScanCounter);
+		SET_MIN(mdh_min.ulTimeStamp,           cur.ulTimeStamp);
+		SET_MAX(mdh_max.ulTimeStamp,           cur.ulTimeStamp);
+		SET_MIN(mdh_min.ulPMUTimeStamp,        cur.ulPMUTimeStamp);
+		SET_MAX(mdh_max.ulPMUTimeStamp,        cur.ulPMUTimeStamp);
+		SET_MIN(mdh_min.ushSamplesInScan,      cur.ushSamplesInScan);
+		SET_MAX(mdh_max.ushSamplesInScan,      cur.ushSamplesInScan);
+		SET_MIN(mdh_min.ushUsedChannels,       cur.ushUsedChannels);
+		SET_MAX(mdh_max.ushUsedChannels,       cur.ushUsedChannels);
+		SET_MIN(mdh_min.ushKSpaceCentreColumn, cur.ushKSpaceCentreColumn);
+		SET_MAX(mdh_max.ushKSpaceCentreColumn, cur.ushKSpaceCentreColumn);
+		SET_MIN(mdh_min.ushCoilSelect,         cur.ushCoilSelect);
+		SET_MAX(mdh_max.ushCoilSelect,         cur.ushCoilSelect);
+		SET_MIN(mdh_min.fReadOutOffcentre,     cur.fReadOutOffcentre);
+		SET_MAX(mdh_max.fReadOutOffcentre,     cur.fReadOutOffcentre);
+		SET_MIN(mdh_min.ulTimeSinceLastRF,     cur.ulTimeSinceLastRF);
+		SET_MAX(mdh_max.ulTimeSinceLastRF,     cur.ulTimeSinceLastRF);
+		SET_MIN(mdh_min.ushKSpaceCentreLineNo, cur.ushKSpaceCentreLineNo);
+		SET_MAX(mdh_max.ushKSpaceCentreLineNo, cur.ushKSpaceCentreLineNo);
+		SET_MIN(mdh_min.ushKSpaceCentrePartitionNo, cur.ushKSpaceCentrePartitionNo);
+		SET_MAX(mdh_max.ushKSpaceCentrePartitionNo, cur.ushKSpaceCentrePartitionNo);
 		for (int i = 0; i < MDH_NUMBEROFICEPROGRAMPARA_VB; i++)
 		{
-			SET_MIN(m_mdh_min.aushIceProgramPara[i], next->mdh.aushIceProgramPara[i]);
-			SET_MAX(m_mdh_max.aushIceProgramPara[i], next->mdh.aushIceProgramPara[i]);
+			SET_MIN(mdh_min.aushIceProgramPara[i], cur.aushIceProgramPara[i]);
+			SET_MAX(mdh_max.aushIceProgramPara[i], cur.aushIceProgramPara[i]);
 		}
 		for (int i = 0; i < MDH_FREEHDRPARA_VB; i++)
 		{
-			SET_MIN(m_mdh_min.aushFreePara[i], next->mdh.aushFreePara[i]);
-			SET_MAX(m_mdh_max.aushFreePara[i], next->mdh.aushFreePara[i]);
+			SET_MIN(mdh_min.aushFreePara[i], cur.aushFreePara[i]);
+			SET_MAX(mdh_max.aushFreePara[i], cur.aushFreePara[i]);
 		}
-		SET_MIN(m_mdh_min.ushChannelId,          next->mdh.ushChannelId);
-		SET_MAX(m_mdh_max.ushChannelId,          next->mdh.ushChannelId);
+		SET_MIN(mdh_min.ushChannelId,          cur.ushChannelId);
+		SET_MAX(mdh_max.ushChannelId,          cur.ushChannelId);
+	}
+
+	//The loop counters are reduced column by column
+	uint16_t lc_min[MDH_NUMBEROFLOOPCOUNTERS], lc_max[MDH_NUMBEROFLOOPCOUNTERS];
+	for (int c = 0; c < MDH_NUMBEROFLOOPCOUNTERS; c++) {
+		const std::vector<uint16_t>& column = m_lc[c];
+		min_max_u16(&column[0], column.size(), lc_min[c], lc_max[c]);
 
-		next = (SiemensMdhNode*)next->next;
+		std::vector<unsigned long>& histogram = m_lc_histogram[c];
+		histogram.assign(lc_max[c] + 1, 0);
+		for (size_t n = 0; n < column.size(); n++) {
+			histogram[column[n]]++;
+		}
 	}
+	memcpy(&mdh_min.sLC, lc_min, sizeof(lc_min));
+	memcpy(&mdh_max.sLC, lc_max, sizeof(lc_max));
+
+	m_mdh_min = mdh_min;
+	m_mdh_max = mdh_max;
 
 	m_min_max_is_valid = true;
 
@@ -270,12 +267,7 @@ int SiemensRawData::UpdateMinMax()
 
 long SiemensRawData::GetNumberOfNodes()
 {
-	return m_number_of_nodes;
-}
-
-SiemensMdhNode* SiemensRawData::GetFirstNode()
-{
-	return m_first_node;
+	return m_mdh.size();
 }
 
 sMDH* SiemensRawData::GetMinValues()
@@ -291,6 +283,12 @@ sMDH* SiemensRawData::GetMaxValues()
 	return &m_mdh_max;
 }
 
+const std::vector<unsigned long>& SiemensRawData::GetLoopCounterHistogram(MdhLoopCounter counter)
+{
+	if (!m_min_max_is_valid) UpdateMinMax();
+	return m_lc_histogram[counter];
+}
+
 int SiemensRawData::GetMeasYapsParameter(std::string parameter_name, std::string& value)
 {
 	std::map<std::string, std::string>::iterator it;
@@ -6,6 +6,7 @@
 #include <fstream>
 #include <map>
 #include <string>
+#include <vector>
 
 #define MDH_NUMBEROFEVALINFOMASK   2
 
@@ -56,6 +57,25 @@ struct mdhLC {
   uint16_t ushIde;
 };
 
+/* Loop counters of mdhLC, in the order of the struct */
+enum MdhLoopCounter {
+  LC_LINE,
+  LC_ACQUISITION,
+  LC_SLICE,
+  LC_PARTITION,
+  LC_ECHO,
+  LC_PHASE,
+  LC_REPETITION,
+  LC_SET,
+  LC_SEG,
+  LC_IDA,
+  LC_IDB,
+  LC_IDC,
+  LC_IDD,
+  LC_IDE,
+  MDH_NUMBEROFLOOPCOUNTERS
+};
+
 struct mdhCutOff {
   uint16_t ushPre;
   uint16_t ushPost;
@@ -175,14 +195,6 @@ struct MrParcRaidFileHeader
 };
 
 
-typedef struct
-{
-  sMDH mdh;
-  void* previous;
-  void* next;
-  float* data;
-} SiemensMdhNode;
-
 typedef struct
 {
   uint32_t matrix_size[3];
@@ -198,6 +210,8 @@ typedef struct
   uint32_t acceleration_factor_3d;
 } SiemensBaseParameters;
 
+/* Scans of a VB file. The headers are kept in one vector and the samples of all scans in one
+   arena, so scan i is GetMdh(i) with GetMdh(i).ushSamplesInScan complex samples at GetData(i). */
 class SiemensRawData
 {
 public:
@@ -206,10 +220,17 @@ public:
 
   int ReadRawFile(char* filename);
   long GetNumberOfNodes();
-  SiemensMdhNode* GetFirstNode();
+  const sMDH& GetMdh(long index) const { return m_mdh[index]; }
+  const float* GetData(long index) const { return &m_data[m_data_offset[index]]; }
   sMDH* GetMinValues();
   sMDH* GetMaxValues();
 
+  /* Value of a loop counter for every scan, in scan order */
+  const std::vector<uint16_t>& GetLoopCounters(MdhLoopCounter counter) const { return m_lc[counter]; }
+
+  /* Number of scans for every value 0..max of a loop counter */
+  const std::vector<unsigned long>& GetLoopCounterHistogram(MdhLoopCounter counter);
+
   SiemensBaseParameters GetBaseParameters() {return m_base_parameters;}
   
   int GetMeasYapsParameter(std::string parameter_name, std::string& value);
@@ -218,14 +239,14 @@ public:
 
 protected:
   int ReadMdhNode(std::ifstream* f);
-  int DeleteNode(SiemensMdhNode* node);
-  int DeleteNodeList();
   int UpdateMinMax();
   int ParseMeasYaps();
 
-  SiemensMdhNode* m_first_node;
-  SiemensMdhNode* m_last_node;
-  long            m_number_of_nodes;
+  std::vector<sMDH>     m_mdh;
+  std::vector<uint64_t> m_data_offset; //Index of the first float of each scan in m_data
+  std::vector<float>    m_data;
+  std::vector<uint16_t> m_lc[MDH_NUMBEROFLOOPCOUNTERS]; //sLC of every scan, one column per counter
+  std::vector<unsigned long> m_lc_histogram[MDH_NUMBEROFLOOPCOUNTERS];
   sMDH            m_mdh_min;
   sMDH            m_mdh_max;
   bool            m_min_max_is_valid;
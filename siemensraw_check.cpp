@@ -0,0 +1,158 @@
+// Checks the loop counter minimum, maximum and histograms of SiemensRawData against a scalar loop. The counters
+// are reduced eight at a time with SSE2 (NEON on ARM), so synthetic VB files with 0, 7, 8, 9 and 1001 scans are
+// read, with values on both sides of 0x8000, where the SSE2 path flips the sign bit. Returns 1 if a value differs.
+
+#include "siemensraw.h"
+#include "benchmark_fixtures.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+static const uint16_t special_values[] = {0, 0x7fff, 0x8000, 0xffff};
+
+// Loop counter c of scans scans. The columns cover only the special values, only the upper or lower half of the
+// range, the whole range, and a minimum or maximum that is only found in the last scan.
+static std::vector<uint16_t> make_column(int c, size_t scans, std::mt19937 &rng)
+{
+    std::vector<uint16_t> column(scans);
+    for (size_t n = 0; n < scans; n++) {
+        uint16_t v = (uint16_t) rng();
+        switch (c % 4) {
+        case 0: column[n] = special_values[rng() % 4]; break;
+        case 1: column[n] = n % 5 == 0 ? special_values[2 + rng() % 2] : (uint16_t) (v | 0x8000); break;
+        case 2: column[n] = n % 5 == 0 ? special_values[rng() % 2] : (uint16_t) (v & 0x7fff); break;
+        default: column[n] = n % 7 == 0 ? special_values[rng() % 4] : v; break;
+        }
+    }
+    if (scans > 0 && c == LC_IDD) {
+        std::fill(column.begin(), column.end(), 0x7fff);
+        column.back() = 0x8000;
+    }
+    if (scans > 0 && c == LC_IDE) {
+        std::fill(column.begin(), column.end(), 0x8000);
+        column.back() = 0x7fff;
+    }
+    return column;
+}
+
+// A VB file with a MeasYaps buffer and one channel of 4 samples per scan, as ReadRawFile expects it
+static void write_vb_file(const std::string &filename, const std::vector<uint16_t> (&columns)[MDH_NUMBEROFLOOPCOUNTERS],
+                          size_t scans)
+{
+    SyntheticVBFile file(filename, "MeasYaps",
+                         "sKSpace.lBaseResolution = 4\n"
+                         "sKSpace.lPhaseEncodingLines = 16\n"
+                         "sKSpace.lPartitions = 1\n"
+                         "sKSpace.dPhaseResolution = 1.0\n"
+                         "sKSpace.dSliceResolution = 1.0\n"
+                         "sKSpace.ucDimension = 0x2\n"
+                         "sPat.lAccelFactPE = 1\n"
+                         "sPat.lAccelFact3D = 1\n"
+                         "sRXSPEC.alDwellTime[0] = 2500\n");
+
+    for (size_t n = 0; n < scans; n++) {
+        sMDH mdh;
+        memset(&mdh, 0, sizeof(mdh));
+        mdh.ulScanCounter = (uint32_t) n + 1;
+        mdh.ushSamplesInScan = 4;
+        mdh.ushUsedChannels = 1;
+        uint16_t lc[MDH_NUMBEROFLOOPCOUNTERS];
+        for (int c = 0; c < MDH_NUMBEROFLOOPCOUNTERS; c++) {
+            lc[c] = columns[c][n];
+        }
+        memcpy(&mdh.sLC, lc, sizeof(lc));
+
+        float samples[8];
+        for (int k = 0; k < 8; k++) {
+            samples[k] = (float) (n * 8 + k);
+        }
+        file.writeChannel(mdh, samples);
+    }
+    file.writeAcqEnd();
+}
+
+static bool check(size_t scans, std::mt19937 &rng)
+{
+    std::vector<uint16_t> columns[MDH_NUMBEROFLOOPCOUNTERS];
+    for (int c = 0; c < MDH_NUMBEROFLOOPCOUNTERS; c++) {
+        columns[c] = make_column(c, scans, rng);
+    }
+
+    TemporaryDirectory dir("siemensraw_check");
+    std::string filename = dir.file("meas.dat");
+    write_vb_file(filename, columns, scans);
+
+    SiemensRawData raw;
+    raw.ReadRawFile(const_cast<char *>(filename.c_str()));
+
+    bool ok = true;
+    if (raw.GetNumberOfNodes() != (long) scans) {
+        std::cout << scans << " scans: read " << raw.GetNumberOfNodes() << std::endl;
+        return false;
+    }
+    for (size_t n = 0; n < scans; n++) {
+        if (raw.GetMdh(n).ulScanCounter != n + 1 || raw.GetData(n)[7] != (float) (n * 8 + 7)) {
+            std::cout << scans << " scans: scan " << n << " differs" << std::endl;
+            ok = false;
+            break;
+        }
+    }
+
+    uint16_t lc_min[MDH_NUMBEROFLOOPCOUNTERS], lc_max[MDH_NUMBEROFLOOPCOUNTERS];
+    memcpy(lc_min, &raw.GetMinValues()->sLC, sizeof(lc_min));
+    memcpy(lc_max, &raw.GetMaxValues()->sLC, sizeof(lc_max));
+
+    for (int c = 0; c < MDH_NUMBEROFLOOPCOUNTERS; c++) {
+        const std::vector<uint16_t> &column = columns[c];
+
+        // Reference, an empty file has all values at 0 and no histograms
+        uint16_t min = scans ? 0xffff : 0;
+        uint16_t max = 0;
+        for (size_t n = 0; n < scans; n++) {
+            min = std::min(min, column[n]);
+            max = std::max(max, column[n]);
+        }
+        std::vector<unsigned long> histogram;
+        if (scans) {
+            histogram.assign(max + 1, 0);
+        }
+        for (size_t n = 0; n < scans; n++) {
+            histogram[column[n]]++;
+        }
+
+        if (raw.GetLoopCounters((MdhLoopCounter) c) != column) {
+            std::cout << scans << " scans, loop counter " << c << ": values differ" << std::endl;
+            ok = false;
+        }
+        if (lc_min[c] != min || lc_max[c] != max) {
+            std::cout << scans << " scans, loop counter " << c << ": min/max " << lc_min[c] << "/" << lc_max[c]
+                      << ", expected " << min << "/" << max << std::endl;
+            ok = false;
+        }
+        if (raw.GetLoopCounterHistogram((MdhLoopCounter) c) != histogram) {
+            std::cout << scans << " scans, loop counter " << c << ": histogram differs" << std::endl;
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+int main()
+{
+    const size_t lengths[] = {0, 7, 8, 9, 1001};
+
+    std::mt19937 rng(2024);
+    bool ok = true;
+    for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+        bool length_ok = check(lengths[i], rng);
+        std::cout << lengths[i] << " scans: " << (length_ok ? "ok" : "differs") << std::endl;
+        ok = ok && length_ok;
+    }
+    return ok ? 0 : 1;
+}
@@ -1,6 +1,8 @@
 #include <math.h>
 #include <stdio.h>
 
+#include "vds.h"
+
 #define GAMMA 	4258.0		/* Hz/G */
 #define PI	3.141592	/* pi */
 
@@ -105,7 +107,7 @@
 %	always.
 %
 %	The choice of whether or not to use [6] or [7], and the
-%	solving for r2 or r1 is done by calcthetadotdot().
+%	solving for r2 or r1 is done by vds_step().
 %
 %	Once the second derivative of theta(q) or r is obtained,
 %	it can be integrated to give q1 and r1, and then integrated
@@ -123,134 +125,178 @@
 
 
 /* ----------------------------------------------------------------------- */
-void calcthetadotdot(double slewmax, double gradmax, double kr, 
-					 double krdot, double Tgsample, double Tdsample, int Ninterleaves,
-					 double* fov, int numfov, double* thetadotdot, double* krdotdot)
-/*
- * Function calculates the 2nd derivative of kr and theta at each
- * sample point within calc_vds().  ie, this is the iterative loop
- * for calc_vds.  See the text at the top of this file for more details
- * */
-
-//double slewmax;		/*	Maximum slew rate, G/cm/s		*/
-//double gradmax;		/* 	maximum gradient amplitude, G/cm	*/
-//double kr;		/* 	Current kr. */
-//double krdot;		/*	Current krdot. */
-//double Tgsample;	/*	Gradient Sample period (s) 	*/
-//double Tdsample;	/*	Data Sample period (s) 		*/
-//int Ninterleaves;	/*	Number of interleaves			*/
-//double *fov;		/*	FOV coefficients		*/
-//int numfov;		/*	Number of FOV coefficients		*/
-//double *thetadotdot;	/*	[output] 2nd derivative of theta.	*/
-//double *krdotdot;	/*	[output] 2nd derivative of kr		*/
+/* Values of vds_step() that do not change from sample to sample. */
+struct vds_constants
+	{
+	double gammaslewmaxsq;	/* (GAMMA*slewmax)^2 */
+	double gradmax;		/* Maximum gradient amplitude, G/cm */
+	double Tgsample;	/* Gradient Sample period (s) */
+	double Tdsample;	/* Data Sample period (s) */
+	int Ninterleaves;	/* Number of interleaves */
+	const double *fov;	/* FOV coefficients */
+	int numfov;		/* Number of FOV coefficients */
+	};
 
 /* ----------------------------------------------------------------------- */
+static inline void vds_step(const vds_constants &c, double kr, double krdot,
+			    double *thetadotdot, double *krdotdot)
+/*
+ * Calculates the 2nd derivative of kr and theta at each sample point,
+ * the iterative loop of the design. This was calcthetadotdot() of the
+ * original C code. The FOV polynomial is evaluated with Horner's rule and
+ * the squares are multiplied out; everything else is evaluated in the same
+ * order as before, so that the design does not change: the integration
+ * amplifies differences in the last bit where the gradient and the slew
+ * rate limit take turns.
+ */
 {
-double fovval=0;	/* FOV for this value of kr	*/
-double dfovdrval=0;	/* dFOV/dkr for this value of kr	*/
-double gmaxfov;		/* FOV-limited Gmax.	*/
-double maxkrdot;
-int count;
-
-double tpf;	/* Used to simplify expressions. */
-double tpfsq;	/* 	" 		"        */
-
-double qdfA, qdfB, qdfC;	/* Quadratic formula coefficients */
-double rootparta,rootpartb;
-
-
-
-if (DEBUG_VDS>1)
+double fovval = c.fov[c.numfov-1];	/* FOV for this value of kr	*/
+double dfovdrval = 0;			/* dFOV/dkr for this value of kr	*/
+for (int count = c.numfov-2; count >= 0; count--)
 	{
-	printf("calcthetadotdot:  slewmax=%8.2f, gmax=%6.2f, \n",
-			slewmax,gradmax);
-	printf("        kr=%8.4f, Tg=%9.6f, N=%d, nfov=%d \n", 
-	       kr,Tgsample,Ninterleaves,numfov);
+	dfovdrval = dfovdrval*kr + fovval;
+	fovval = fovval*kr + c.fov[count];
 	}
 
-	/* Calculate the actual FOV and dFOV/dkr for this R,
-	 * based on the fact that the FOV is expressed 
-	 * as a polynomial in kr.*/
-
-for (count=0; count < numfov; count++)
-	{
-	fovval = fovval + fov[count]*pow(kr,count);
-	if (count > 0)
-		dfovdrval = dfovdrval + count*fov[count]*pow(kr,count-1);
-	}
-
-	/* Calculate FOV limit on gmax.  This is the rate of motion along
-	 * a trajectory, and really should not be a limitation.  Thus,
-	 * it is reasonable to comment out the following lines. */
-
-gmaxfov = 1/GAMMA / fovval / Tdsample;	
+	/* FOV limit on gmax */
+double gradmax = c.gradmax;
+double gmaxfov = 1/GAMMA / fovval / c.Tdsample;
 if (gradmax > gmaxfov)
-	gradmax = gmaxfov;	
-
+	gradmax = gmaxfov;
 
 	/* Maximum dkr/dt, based on gradient amplitude.  */
+double gammagradmax = GAMMA*gradmax;
+double tpfkr = 2*PI*fovval*kr/c.Ninterleaves;
+double maxkrdot = sqrt(gammagradmax*gammagradmax / (1+tpfkr*tpfkr));
 
-maxkrdot = sqrt(pow(GAMMA*gradmax,2) / (1+pow(2*PI*fovval*kr/Ninterleaves,2)));
-if (DEBUG_VDS>1)
-	printf("calcthetadotdot:  maxkrdot = %g \n",maxkrdot);
-
-	/* These two are just to simplify expressions below */
-tpf = 2*PI*fovval/Ninterleaves;
-tpfsq = pow(tpf,2);
-if (DEBUG_VDS>1)
-	printf("calcthetadotdot:  tpf = %8.4f,  tpfsq = %8.4f  \n",tpf,tpfsq);
-
-
-
+double tpf = 2*PI*fovval/c.Ninterleaves;
+double tpfsq = tpf*tpf;
 
 if (krdot > maxkrdot)	/* Then choose krdotdot so that krdot is in range */
-	{	
-	*krdotdot = (maxkrdot - krdot)/Tgsample;
+	{
+	*krdotdot = (maxkrdot - krdot)/c.Tgsample;
 	}
-
 else			/* Choose krdotdot based on max slew rate limit. */
 	{
-
-		/* Set up for quadratic formula solution. */
-
-	qdfA = 1+tpfsq*kr*kr;
-	qdfB = 2*tpfsq*kr*krdot*krdot + 
+	double krdot4 = pow(krdot,4);
+	double qdfA = 1+tpfsq*kr*kr;
+	double qdfB = 2*tpfsq*kr*krdot*krdot +
 			2*tpfsq/fovval*dfovdrval*kr*kr*krdot*krdot;
-	qdfC = pow(tpfsq*kr*krdot*krdot,2) + 4*tpfsq*pow(krdot,4) +
-			pow(tpf*dfovdrval/fovval*kr*krdot*krdot,2) +
-			4*tpfsq*dfovdrval/fovval*kr*pow(krdot,4) -
-			pow(GAMMA*slewmax,2);
-
-	if (DEBUG_VDS>1)
-		printf("calcthetadotdot:  qdfA, qdfB, qdfC = %g, %g, %g \n",
-				qdfA, qdfB, qdfC);
+	double qdfC1 = tpfsq*kr*krdot*krdot;
+	double qdfC3 = tpf*dfovdrval/fovval*kr*krdot*krdot;
+	double qdfC = qdfC1*qdfC1 + 4*tpfsq*krdot4 +
+			qdfC3*qdfC3 +
+			4*tpfsq*dfovdrval/fovval*kr*krdot4 -
+			c.gammaslewmaxsq;
 
-	rootparta = -qdfB/(2*qdfA);
-	rootpartb = qdfB*qdfB/(4*qdfA*qdfA) - qdfC/qdfA;
-	if (DEBUG_VDS>1)
-		printf("calcthetadotdot:  rootparta, rootpartb = %g, %g \n",
-				rootparta, rootpartb);
+	double rootparta = -qdfB/(2*qdfA);
+	double rootpartb = qdfB*qdfB/(4*qdfA*qdfA) - qdfC/qdfA;
 
 	if (rootpartb < 0)	/* Safety check - if complex, take real part.*/
-
 		*krdotdot = rootparta;
-
 	else
 		*krdotdot = rootparta + sqrt(rootpartb);
+	}
+
+*thetadotdot = tpf*dfovdrval/fovval*krdot*krdot + tpf*(*krdotdot);
+}
+
+
+/* ----------------------------------------------------------------------- */
+int calc_vds_kspace(double slewmax, double gradmax, double Tgsample, double Tdsample, int Ninterleaves,
+		    const double* fov, int numfov, double krmax, int ngmax, double* kx, double* ky)
+/*
+ * The integration is sequential, so kr and theta of every sample are
+ * stored first (in kx and ky) and converted to x and y afterwards, in a
+ * loop without dependencies between the samples.
+ */
+{
+vds_constants c;
+c.gammaslewmaxsq = (GAMMA*slewmax)*(GAMMA*slewmax);
+c.gradmax = gradmax;
+c.Tgsample = Tgsample;
+c.Tdsample = Tdsample;
+c.Ninterleaves = Ninterleaves;
+c.fov = fov;
+c.numfov = numfov;
+
+double kr = 0;		/* Current value of kr	*/
+double krdot = 0;	/* Current value of 1st derivative of kr */
+double krdotdot = 0;	/* Current value of 2nd derivative of kr */
+double theta = 0;	/* Current value of theta */
+double thetadot = 0;	/* Current value of 1st derivative of theta */
+double thetadotdot = 0;	/* Current value of 2nd derivative of theta */
+
+int gradcount = 0;
+while ((kr < krmax) && (gradcount < ngmax))
+	{
+	vds_step(c, kr, krdot, &thetadotdot, &krdotdot);
+
+	/* Integrate to obtain new values of kr, krdot, theta and thetadot:*/
+
+	thetadot = thetadot + thetadotdot * Tgsample;
+	theta = theta + thetadot * Tgsample;
+
+	krdot = krdot + krdotdot * Tgsample;
+	kr = kr + krdot * Tgsample;
 
+	kx[gradcount] = kr;
+	ky[gradcount] = theta;
+	gradcount++;
+	}
 
-	/* Could check resulting slew rate here, as in q2r21.m. */
+for (int i = 0; i < gradcount; i++)
+	{
+	double r = kx[i];
+	double q = ky[i];
+	kx[i] = r * cos(q);
+	ky[i] = r * sin(q);
 	}
 
-	/* Calculate thetadotdot */
+return gradcount;
+}
 
-	
-*thetadotdot = tpf*dfovdrval/fovval*krdot*krdot + tpf*(*krdotdot);
 
-if (DEBUG_VDS>1)
-	printf("calcthetadot:  r=%8.4f,  r'=%8.4f,  r''=%g  q''=%g \n",
-		kr,krdot,*krdotdot,*thetadotdot);
+/* ----------------------------------------------------------------------- */
+template <typename T>
+static void vds_trajectory(const double* kx, const double* ky, int ngrad, int Nints, double scale, T* traj)
+/*
+ * calc_traj() sums up the gradients, which gives back the k-space
+ * position of the previous sample. Each interleave is the first one
+ * rotated by inter*2*PI/Nints, so only the rotation is computed per
+ * interleave and the loop over the samples is a plain multiply-add.
+ */
+{
+for (int inter = 0; inter < Nints; inter++)
+	{
+	double rotation = (inter * 2 * PI)/Nints;
+	double cr = scale * cos(rotation);
+	double sr = scale * sin(rotation);
+	T* out = traj + (size_t) inter * ngrad * 2;
+
+	if (ngrad > 0)
+		{
+		out[0] = 0;
+		out[1] = 0;
+		}
+	for (int i = 1; i < ngrad; i++)
+		{
+		double x = kx[i-1];
+		double y = ky[i-1];
+		out[2*i] = (T) (x*cr + y*sr);
+		out[2*i+1] = (T) (y*cr - x*sr);
+		}
+	}
+}
 
+void calc_vds_trajectory(const double* kx, const double* ky, int ngrad, int Nints, double scale, float* traj)
+{
+vds_trajectory(kx, ky, ngrad, Nints, scale, traj);
+}
+
+void calc_vds_trajectory(const double* kx, const double* ky, int ngrad, int Nints, double scale, double* traj)
+{
+vds_trajectory(kx, ky, ngrad, Nints, scale, traj);
 }
 
 
@@ -275,6 +321,8 @@ void calc_vds(double slewmax,double gradmax,double Tgsample,double Tdsample,int
  * 	sampling rate.  It is highly recommended to OVERSAMPLE the gradient
  * 	in the design to make the integration more stable.
  *
+ * 	The gradients are the differences of the k-space positions
+ * 	calculated by calc_vds_kspace().
  * */
 
 //double slewmax;		/*	Maximum slew rate, G/cm/s		*/
@@ -292,105 +340,27 @@ void calc_vds(double slewmax,double gradmax,double Tgsample,double Tdsample,int
 
 /* ----------------------------------------------------------------------- */
 {
-int gradcount=0;
-
-double kr=0;			/* Current value of kr	*/
-double krdot = 0;		/* Current value of 1st derivative of kr */
-double krdotdot = 0;		/* Current value of 2nd derivative of kr */
-
-double theta=0;			/* Current value of theta */
-double thetadot=0;		/* Current value of 1st derivative of theta */
-double thetadotdot=0;		/* Current value of 2nd derivative of theta */
-
-double lastkx=0;		/* x-component of last k-location. */
-double lastky=0;		/* y-component of last k-location */
-double kx, ky;			/* x and y components of current k-location */
-
-double *gxptr, *gyptr;		/* Pointers to gradient variables. */
-
+double *kx = new double[ngmax > 0 ? ngmax : 1];
+double *ky = new double[ngmax > 0 ? ngmax : 1];
 
+*numgrad = calc_vds_kspace(slewmax, gradmax, Tgsample, Tdsample, Ninterleaves,
+			   fov, numfov, krmax, ngmax, kx, ky);
 
+*xgrad = new double[*numgrad > 0 ? *numgrad : 1];
+*ygrad = new double[*numgrad > 0 ? *numgrad : 1];
 
-if (DEBUG_VDS>0)
-	printf("calc_vds:  First run. \n");
-
-	/* First just find the gradient length. */
-
-while ((kr < krmax) && (gradcount < ngmax))
+double lastkx = 0;	/* x-component of last k-location. */
+double lastky = 0;	/* y-component of last k-location */
+for (int i = 0; i < *numgrad; i++)
 	{
-	calcthetadotdot(slewmax,gradmax,kr,krdot,Tgsample,Tdsample,
-			Ninterleaves, fov,numfov, &thetadotdot, &krdotdot);
-
-	/* Integrate to obtain new values of kr, krdot, theta and thetadot:*/
-
-	thetadot = thetadot + thetadotdot * Tgsample;
-	theta = theta + thetadot * Tgsample;
-
-	krdot = krdot + krdotdot * Tgsample;
-	kr = kr + krdot * Tgsample;
-
-	gradcount++;
-
-	}
-
-
-
-	/* Allocate memory for gradients. */
-
-*numgrad = gradcount;
-if (DEBUG_VDS>0)
-	printf("Allocating for %d gradient points. \n",*numgrad);
-
-//*xgrad = (double *)malloc(*numgrad*sizeof(double));
-//*ygrad = (double *)malloc(*numgrad*sizeof(double));
-
-*xgrad = new double[*numgrad*sizeof(double)];
-*ygrad = new double[*numgrad*sizeof(double)];
-
-	/* Reset parameters */
-
-kr=0;
-krdot=0;
-theta=0;
-thetadot=0;
-gradcount=0;
-gxptr = *xgrad;
-gyptr = *ygrad;
-
-
-	/* Now re-calculate gradient to find length. */
-
-if (DEBUG_VDS>0)
-	printf("calc_vds:  First run. \n");
-
-while ((kr < krmax) && (gradcount < ngmax))
-	{
-	calcthetadotdot(slewmax,gradmax,kr,krdot,Tgsample,Tdsample,
-			Ninterleaves, fov,numfov, &thetadotdot, &krdotdot);
-
-	/* Integrate to obtain new values of kr, krdot, theta and thetadot:*/
-
-	thetadot = thetadot + thetadotdot * Tgsample;
-	theta = theta + thetadot * Tgsample;
-
-	krdot = krdot + krdotdot * Tgsample;
-	kr = kr + krdot * Tgsample;
-
-	/* Define current gradient values from kr and theta. */
-
-	kx = kr * cos(theta);
-	ky = kr * sin(theta);
-	*gxptr++ = (1/GAMMA/Tgsample) * (kx-lastkx);
-	*gyptr++ = (1/GAMMA/Tgsample) * (ky-lastky);
-	lastkx = kx;
-	lastky = ky;
-
-	if (DEBUG_VDS>0)
-		printf("Current kr is %6.3f \n",kr);
-
-	gradcount++;
+	(*xgrad)[i] = (1/GAMMA/Tgsample) * (kx[i]-lastkx);
+	(*ygrad)[i] = (1/GAMMA/Tgsample) * (ky[i]-lastky);
+	lastkx = kx[i];
+	lastky = ky[i];
 	}
 
+delete[] kx;
+delete[] ky;
 }
  
 
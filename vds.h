@@ -0,0 +1,29 @@
+#ifndef VDS_H_
+#define VDS_H_
+
+/* Variable density spiral design, see the description at the top of vds.cpp */
+
+/* Designs the gradient waveform, returned in new[] arrays of *numgrad samples */
+void calc_vds(double slewmax,double gradmax,double Tgsample,double Tdsample,int Ninterleaves,
+              double* fov, int numfov,double krmax,
+              int ngmax, double** xgrad,double** ygrad,int* numgrad);
+
+/* Integrates the gradients of calc_vds() to the trajectory of every interleave, and the density weights */
+void calc_traj(double* xgrad, double* ygrad, int ngrad, int Nints, double Tgsamp, double krmax,
+               double** x_trajectory, double** y_trajectory,
+               double** weights);
+
+/* Same design as calc_vds(), in a single pass. Instead of the gradients it writes the k-space
+ * position (1/cm) of the first interleave after every gradient sample to kx and ky, which must
+ * have room for ngmax samples. Returns the number of samples. */
+int calc_vds_kspace(double slewmax, double gradmax, double Tgsample, double Tdsample, int Ninterleaves,
+                    const double* fov, int numfov, double krmax, int ngmax, double* kx, double* ky);
+
+/* Trajectory of all interleaves from the k-space positions of calc_vds_kspace(), without the
+ * weights: traj[(interleave * ngrad + sample) * 2 + {0,1}] is the x and y position of the
+ * sample, multiplied by scale. The trajectory starts at the centre of k-space, as in calc_traj(),
+ * which returns the same positions with scale = 1 / krmax. */
+void calc_vds_trajectory(const double* kx, const double* ky, int ngrad, int Nints, double scale, float* traj);
+void calc_vds_trajectory(const double* kx, const double* ky, int ngrad, int Nints, double scale, double* traj);
+
+#endif /* VDS_H_ */
@@ -0,0 +1,148 @@
+// Checks calc_vds_kspace(), calc_vds_trajectory() and calc_vds() against stored results of the previous
+// calc_vds() and calc_traj() and times them, on spiral designs with up to ngmax = 1e5 samples. Returns 1 if a
+// design differs:
+//  - the number of samples must be the same,
+//  - the gradients of calc_vds() at 8 points must be within 1e-9 of gmax with a single FOV coefficient,
+//  - the trajectories at 16 points, as computeSpiralTrajectory() stores them, must be within 1 float ulp with
+//    a single FOV coefficient, and the sum of their squares over all samples within 1e-9 (relative),
+//  - with three coefficients the FOV polynomial is evaluated with Horner's rule, which changes the last bits
+//    of the design: gradients within 1e-5 of gmax, trajectories within 5e-7, the sum of squares within 1e-6.
+// The stored results are from the x86-64 -O2 release build, other optimization levels round differently
+// (up to 7e-7 in the gradients of the design with three coefficients).
+
+#include "vds.h"
+#include "benchmark_fixtures.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+struct SpiralDesign
+{
+    double smax;
+    double gmax;
+    double krmax;
+    long dwell_time; // ns
+    int interleaves;
+    std::vector<double> fov;
+};
+
+// Results of the previous implementation for the designs in main(), in the same order
+struct StoredDesign
+{
+    int samples;
+    double sum_of_squares;   // Of all trajectory values
+    double gradients[8][2];  // x and y of sample k * (samples - 1) / 7
+    float trajectory[16][2]; // x and y of value k * (samples * interleaves - 1) / 15
+};
+
+static const StoredDesign stored_designs[] = {
+    {4828, 9243.7457972552493,
+     {{0.036035764488200034, 0.00013028334882756742}, {-1.3800404036009215, -1.8750606052144432}, {2.393811797774847, 0.17911904403113812}, {2.4002578890425017, -0.01682370347591439}, {0.94880373693642273, -2.2047404086256561}, {-2.3720571009345459, -0.36635741233006719}, {1.2538581974668148, 2.046596894711219}, {-0.052152923737184331, -2.399560743125964}},
+     {{-0, -0}, {0.044717744, -0.0813525617}, {-0.0743446574, -0.133663148}, {-0.105333135, 0.171969444}, {0.160452172, -0.179904118}, {-0.102189563, 0.255173564}, {-0.0975557715, -0.288847983}, {0.318199992, 0.0956492275}, {-0.233809799, 0.270525038}, {-0.213698059, -0.315651059}, {0.361087173, -0.179918647}, {0.182725653, 0.383098602}, {-0.3867383, 0.219179899}, {-0.287262142, -0.364060819}, {0.302547336, -0.375471294}, {0.462494314, 0.189911991}}},
+    {8122, 6959.2804390003839,
+     {{0.029999707699665441, 0.00013243086737820334}, {2.0549150675457661, -0.71727450241415336}, {1.1581749779981489, 2.5014331107029424}, {3.008465852350382, 0.97009703759656529}, {-0.74738917689817874, -3.4010660392270462}, {0.10187047599384327, 3.751793538988109}, {-1.7944661584108457, -3.5634415604266207}, {3.9999126924646613, -0.043567429244775024}},
+     {{-0, -0}, {-0.318802208, -0.0800404996}, {-0.0746717528, -0.0265443586}, {0.191972211, 0.299558103}, {0.0236889608, -0.126142025}, {0.00186115503, -0.381841928}, {0.0358100757, -0.165586546}, {-0.170082852, 0.369802266}, {-0.107010186, -0.175941333}, {0.289135635, -0.320331216}, {-0.231899306, 0.0596643761}, {-0.360324204, 0.278299749}, {0.087180689, 0.256415129}, {0.384606242, -0.284064442}, {0.227756292, -0.195927709}, {-0.352578461, 0.354503542}}},
+    {14169, 79519.049883371757,
+     {{0.011999999758429089, 2.407841756322653e-06}, {2.4149905909704334, 1.5801109126381445}, {-0.096111770620680978, 3.4989634864872259}, {2.4641400326986269, 2.4858016867254187}, {1.7727311519739521, -3.0179927958403416}, {-3.3125844902620498, 1.1302436721129012}, {3.4988599915016492, -0.092329276146685554}, {-3.4989867274965549, 0.086914078358042171}},
+     {{-0, -0}, {0.0496063679, -0.181744322}, {0.241817564, 0.174053326}, {0.370225549, 0.0737742782}, {0.103129826, -0.430819988}, {-0.461915404, 0.191396743}, {-0.182198405, 0.047911711}, {0.0298259445, -0.2964468}, {-0.1219192, -0.357248276}, {-0.424666017, 0.126096755}, {0.396712005, 0.304332316}, {0.132591903, 0.133832663}, {-0.271307796, 0.123058572}, {-0.248426631, 0.284209162}, {0.321535885, 0.304723322}, {0.0652037039, -0.495728791}}},
+    {100000, 3382.0628886373938,
+     {{0.013999434354234222, 0.00012584816838842971}, {-0.53930186152298165, 1.8610790932227785}, {-1.8652550776950045, -1.6551086937427693}, {-1.6231703561410398, 2.2815843225190435}, {2.1154049883429678, -1.8344996932259905}, {2.3964655939906776, -1.4482084729847393}, {2.7266045693976189, -0.63719099117351286}, {-1.2138463737472602, 2.5232897455153611}},
+     {{-0, -0}, {-0.0232938305, -0.0345292501}, {-0.0627178028, 0.0260991119}, {-0.0210405383, -0.088513948}, {0.0705065504, 0.0874449909}, {0.132556468, -0.00150626409}, {-0.135599151, 0.0685892478}, {-0.0894841626, 0.144544691}, {0.0260438286, -0.184809133}, {0.10853117, -0.170532182}, {-0.161597714, -0.1443699}, {0.132646427, 0.188421488}, {-0.242917687, 0.0160246529}, {-0.14183405, -0.212895364}, {-0.117447615, -0.240451872}, {-0.251185626, -0.121106476}}},
+    {93381, 738020.50754523801,
+     {{0.0099999999650505073, 8.3605617002600906e-07}, {1.0181123469473727, -3.8683458913760318}, {1.7840605426575249, -3.5801452661719324}, {-2.5916773699485978, 3.0468694624893482}, {-2.3027477939267285, -3.2707041034997109}, {0.89141329753913257, -3.899423546963662}, {1.4393200761869731, -3.7320850496752396}, {-0.050673809345296854, -3.9996898186604808}},
+     {{-0, -0}, {0.0501785353, -0.248756737}, {-0.348121971, 0.1034282}, {-0.441211551, 0.0686324611}, {0.0556474216, 0.103468716}, {-0.0859410837, 0.271811783}, {0.0040467591, -0.385670632}, {-0.217434809, -0.411063045}, {-0.0996243209, 0.144000202}, {-0.023599308, -0.312379867}, {0.404325873, 0.0463787317}, {0.288599312, -0.387083918}, {0.124476492, 0.17897588}, {0.248845696, 0.230402038}, {-0.0220244378, 0.426635325}, {0.497598797, 0.0489345156}}},
+    {67371, 33209.893556988143,
+     {{0.0099999484649153664, 3.2104501816012392e-05}, {0.023820740855169917, 1.199797088980088}, {0.77810124409857528, 0.91356257115501294}, {-1.0284170877035432, -0.61837146275469868}, {-0.46546064735738818, 1.1060582958707927}, {-1.0298942223573724, -0.61589988576465748}, {-1.1659386719945106, -0.28390013522379604}, {0.0058668832526864063, 1.1999900309207363}},
+     {{-0, -0}, {-0.0568646006, -0.24649705}, {-0.260464907, -0.252569824}, {-0.283470184, -0.344839007}, {-0.110893428, -0.0311630517}, {-0.0371036641, -0.282002658}, {0.385409355, -0.00104230607}, {-0.0689775422, -0.459803671}, {-0.173534468, -0.00782309193}, {-0.310812145, -0.0347258672}, {-0.0920675322, 0.396198243}, {0.0327716321, -0.481675595}, {-0.151479349, 0.155360609}, {0.221699372, 0.256061286}, {-0.426923782, 0.00967279356}, {-0.000659364683, -0.499996752}}}
+};
+
+int main()
+{
+    const int ngmax = 100000;
+
+    std::vector<SpiralDesign> designs;
+    designs.push_back({14414.4, 2.4, 5, 2500, 16, {24}});
+    designs.push_back({15000, 4, 5, 2000, 8, {22}});
+    designs.push_back({12000, 3.5, 10, 1000, 48, {30}});
+    designs.push_back({14000, 2.8, 8, 1000, 1, {24, -4, 0.5}});
+    designs.push_back({20000, 4, 20, 500, 64, {40}});
+    designs.push_back({5000, 1.2, 6, 2000, 4, {24}});
+
+    bool ok = true;
+    for (size_t d = 0; d < designs.size(); d++) {
+        SpiralDesign& s = designs[d];
+        const StoredDesign &stored = stored_designs[d];
+        double sample_time = s.dwell_time * 1e-9;
+        int nfov = (int) s.fov.size();
+
+        // As computeSpiralTrajectory uses it
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        std::vector<double> kx(ngmax), ky(ngmax);
+        int nsamples = calc_vds_kspace(s.smax, s.gmax, sample_time, sample_time, s.interleaves, s.fov.data(), nfov,
+                                       s.krmax, ngmax, kx.data(), ky.data());
+        std::vector<float> traj(2 * (size_t) nsamples * s.interleaves);
+        calc_vds_trajectory(kx.data(), ky.data(), nsamples, s.interleaves, -0.5 / s.krmax, traj.data());
+        double time = seconds_since(start);
+
+        double *xgrad, *ygrad;
+        int ngrad = 0;
+        calc_vds(s.smax, s.gmax, sample_time, sample_time, s.interleaves, s.fov.data(), nfov, s.krmax, ngmax,
+                 &xgrad, &ygrad, &ngrad);
+
+        bool design_ok = nsamples == stored.samples && ngrad == stored.samples;
+        double gradient_error = 0;
+        double trajectory_error = 0;
+        double sum_error = 0;
+        size_t ulps = 0;
+        if (design_ok) {
+            for (int k = 0; k < 8; k++) {
+                int i = (int) ((long) k * (ngrad - 1) / 7);
+                gradient_error = std::max(gradient_error, std::fabs(xgrad[i] - stored.gradients[k][0]));
+                gradient_error = std::max(gradient_error, std::fabs(ygrad[i] - stored.gradients[k][1]));
+            }
+
+            size_t values = traj.size() / 2;
+            for (int k = 0; k < 16; k++) {
+                size_t i = (size_t) k * (values - 1) / 15;
+                for (int c = 0; c < 2; c++) {
+                    float expected = stored.trajectory[k][c];
+                    float error = std::fabs(traj[2 * i + c] - expected);
+                    trajectory_error = std::max(trajectory_error, (double) error);
+                    float ulp = std::nextafter(std::fabs(expected), INFINITY) - std::fabs(expected);
+                    if (error > ulp) {
+                        ulps++;
+                    }
+                }
+            }
+
+            double sum_of_squares = 0;
+            for (size_t i = 0; i < traj.size(); i++) {
+                sum_of_squares += (double) traj[i] * traj[i];
+            }
+            sum_error = std::fabs(sum_of_squares - stored.sum_of_squares) / stored.sum_of_squares;
+
+            if (nfov == 1) {
+                design_ok = gradient_error <= 1e-9 * s.gmax && ulps == 0 && sum_error <= 1e-9;
+            } else {
+                design_ok = gradient_error <= 1e-5 * s.gmax && trajectory_error <= 5e-7 && sum_error <= 1e-6;
+            }
+        }
+        ok = ok && design_ok;
+
+        std::cout << "Interleaves " << std::setw(2) << s.interleaves << ", FOV coefficients " << nfov
+                  << ": samples " << nsamples << " / " << stored.samples
+                  << ", gradient error " << gradient_error
+                  << ", trajectory error " << trajectory_error << " (" << ulps << " > 1 ulp)"
+                  << ", sum of squares error " << sum_error
+                  << ", " << time << " s"
+                  << (design_ok ? "" : "  DIFFERENT") << std::endl;
+
+        delete[] xgrad;
+        delete[] ygrad;
+    }
+
+    return ok ? 0 : 1;
+}